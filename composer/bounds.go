@@ -0,0 +1,110 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"fmt"
+	"math"
+
+	"github.com/qmuntal/gltf"
+	"github.com/qmuntal/gltf/modeler"
+)
+
+type AABB struct {
+	Min [3]float32
+	Max [3]float32
+}
+
+// an AABB containing nothing; extending it with any point yields that point
+func emptyAABB() AABB {
+	inf := float32(math.Inf(1))
+	return AABB{
+		Min: [3]float32{inf, inf, inf},
+		Max: [3]float32{-inf, -inf, -inf},
+	}
+}
+
+func (b AABB) IsEmpty() bool {
+	return b.Min[0] > b.Max[0]
+}
+
+func (b AABB) Union(o AABB) AABB {
+	for i := range 3 {
+		b.Min[i] = min(b.Min[i], o.Min[i])
+		b.Max[i] = max(b.Max[i], o.Max[i])
+	}
+	return b
+}
+
+// returns the sphere circumscribing the box; the radius is negative for an
+// empty box
+func (b AABB) Sphere() (center [3]float32, radius float32) {
+	if b.IsEmpty() {
+		return center, -1
+	}
+	var r2 float64 = 0
+	for i := range 3 {
+		center[i] = (b.Min[i] + b.Max[i]) / 2
+		half := float64(b.Max[i]-b.Min[i]) / 2
+		r2 += half * half
+	}
+	return center, float32(math.Sqrt(r2))
+}
+
+// bounding box of the POSITION attribute of `primitive`, in mesh space
+func primitiveBounds(doc *gltf.Document, primitive *gltf.Primitive) (bounds AABB, err error) {
+	bounds = emptyAABB()
+	pos, ok := primitive.Attributes["POSITION"]
+	if !ok {
+		return
+	}
+
+	/* glTF spec 3.7.2.1: POSITION accessors MUST have min and max defined,
+	but not every exporter bothers */
+	acr := doc.Accessors[pos]
+	if len(acr.Min) == 3 && len(acr.Max) == 3 {
+		for i := range 3 {
+			bounds.Min[i] = float32(acr.Min[i])
+			bounds.Max[i] = float32(acr.Max[i])
+		}
+		return
+	}
+
+	positions, err := modeler.ReadPosition(doc, acr, nil)
+	if err != nil {
+		return bounds, fmt.Errorf(`failed to read positions (%w)`, err)
+	}
+	for _, p := range positions {
+		bounds = bounds.Union(AABB{Min: p, Max: p})
+	}
+	return
+}
+
+// bounding box of every primitive of `mesh`, in mesh space
+func meshBounds(doc *gltf.Document, mesh *gltf.Mesh) (bounds AABB, err error) {
+	bounds = emptyAABB()
+	for _, primitive := range mesh.Primitives {
+		b, err := primitiveBounds(doc, primitive)
+		if err != nil {
+			return bounds, err
+		}
+		bounds = bounds.Union(b)
+	}
+	return
+}
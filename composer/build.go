@@ -27,8 +27,14 @@ import (
 )
 
 type Level struct {
-	GLTF   map[string]string
-	Script map[string]string
+	GLTF       map[string]string
+	Script     map[string]string
+	Compress   bool         // Yaz0 compress vertex data and textures where it pays
+	Quantize   Quantization // store vertex attributes as fixed point where accurate enough
+	Interleave bool         // store each primitive's vertex attributes in one interleaved stream
+	Optimize   bool         // reorder triangles and vertices for the vertex cache
+	Strips     bool         // with Optimize, draw triangle lists as strips where that takes fewer indices
+	Textures   TextureFormats
 }
 
 type Manifest struct {
@@ -36,6 +42,7 @@ type Manifest struct {
 	GameID  string
 	Version uint8
 	Levels  map[string]Level
+	Layout  Layout
 }
 
 func readManifest(name string) (manifest *Manifest, err error) {
@@ -154,7 +161,16 @@ func (r *BuildCmd) Run() error {
 		}
 	}
 
-	gcm, err := GCM(id, loader, dol, tempDir)
+	order := manifest.Layout.Order
+	if manifest.Layout.Trace != "" {
+		traced, err := readAccessProfile(filepath.Join(projectDir, manifest.Layout.Trace))
+		if err != nil {
+			return err
+		}
+		order = append(order, traced...)
+	}
+
+	gcm, err := GCM(id, loader, dol, tempDir, manifest.Layout, order)
 	if err != nil {
 		return fmt.Errorf(`failed to pack GCM image (%w)`, err)
 	}
@@ -0,0 +1,237 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"fmt"
+	"sort"
+
+	"github.com/qmuntal/gltf"
+)
+
+const BVH_LEAF_SIZE int = 4
+const BVH_MAX_DEPTH int = 32 // must match BVH_MAX_DEPTH in runtime/include/pak.h
+
+// exactly one 32B cache line; see struct BVHNode in runtime/include/pak.h
+type BinBVHNode struct {
+	Min   [3]float32
+	Max   [3]float32
+	First uint32 // internal: index of the right child (the left child follows this node). leaf: first item
+	Count uint32 // number of items, 0 for internal nodes
+}
+
+type BinBVHItem struct {
+	Node      uint32
+	Primitive uint32
+}
+
+// row-major affine transform, laid out like libogc's Mtx
+type Mtx [3][4]float64
+
+func identityMtx() Mtx {
+	return Mtx{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}
+}
+
+func (a Mtx) Concat(b Mtx) (out Mtx) {
+	for row := range 3 {
+		for col := range 4 {
+			out[row][col] = a[row][0]*b[0][col] + a[row][1]*b[1][col] + a[row][2]*b[2][col]
+		}
+		out[row][3] += a[row][3]
+	}
+	return
+}
+
+// local transform of `node`, built the same way as update_tree() in
+// render.c: scale, then rotation, then translation
+func nodeMtx(node *gltf.Node) Mtx {
+	q := node.RotationOrDefault()
+	s := node.ScaleOrDefault()
+	t := node.TranslationOrDefault()
+	x, y, z, w := q[0], q[1], q[2], q[3]
+	return Mtx{
+		{(1 - 2*(y*y+z*z)) * s[0], 2 * (x*y - z*w) * s[1], 2 * (x*z + y*w) * s[2], t[0]},
+		{2 * (x*y + z*w) * s[0], (1 - 2*(x*x+z*z)) * s[1], 2 * (y*z - x*w) * s[2], t[1]},
+		{2 * (x*z - y*w) * s[0], 2 * (y*z + x*w) * s[1], (1 - 2*(x*x+y*y)) * s[2], t[2]},
+	}
+}
+
+func (m Mtx) TransformAABB(b AABB) (out AABB) {
+	if b.IsEmpty() {
+		return b
+	}
+	for row := range 3 {
+		center := m[row][3]
+		extent := 0.0
+		for col := range 3 {
+			c := float64(b.Min[col]+b.Max[col]) / 2
+			half := float64(b.Max[col]-b.Min[col]) / 2
+			center += m[row][col] * c
+			if m[row][col] < 0 {
+				extent -= m[row][col] * half
+			} else {
+				extent += m[row][col] * half
+			}
+		}
+		out.Min[row] = float32(center - extent)
+		out.Max[row] = float32(center + extent)
+	}
+	return
+}
+
+func (b AABB) SurfaceArea() float64 {
+	if b.IsEmpty() {
+		return 0
+	}
+	dx := float64(b.Max[0] - b.Min[0])
+	dy := float64(b.Max[1] - b.Min[1])
+	dz := float64(b.Max[2] - b.Min[2])
+	return 2 * (dx*dy + dy*dz + dz*dx)
+}
+
+type bvhItem struct {
+	BinBVHItem
+	Bounds   AABB
+	Centroid [3]float32
+}
+
+// collects the world space bounds of every primitive instance reachable from
+// the model's scenes, with nodes placed as they are at pack time
+func collectBVHItems(doc *gltf.Document, primitiveIdxs map[*gltf.Primitive]int) (items []bvhItem, err error) {
+	visited := map[int]bool{}
+	var walk func(nodeIdx int, parent Mtx) error
+	walk = func(nodeIdx int, parent Mtx) error {
+		if visited[nodeIdx] {
+			return nil
+		}
+		visited[nodeIdx] = true
+
+		node := doc.Nodes[nodeIdx]
+		world := parent.Concat(nodeMtx(node))
+		if node.Mesh != nil {
+			for _, primitive := range doc.Meshes[*node.Mesh].Primitives {
+				bounds, err := primitiveBounds(doc, primitive)
+				if err != nil {
+					return err
+				}
+				if bounds.IsEmpty() {
+					continue
+				}
+				bounds = world.TransformAABB(bounds)
+				item := bvhItem{
+					BinBVHItem: BinBVHItem{Node: uint32(nodeIdx), Primitive: uint32(primitiveIdxs[primitive])},
+					Bounds:     bounds,
+				}
+				for i := range 3 {
+					item.Centroid[i] = (bounds.Min[i] + bounds.Max[i]) / 2
+				}
+				items = append(items, item)
+			}
+		}
+		for _, child := range node.Children {
+			if err := walk(child, world); err != nil {
+				return err
+			}
+		}
+		return nil
+	}
+
+	for _, scene := range doc.Scenes {
+		for _, node := range scene.Nodes {
+			err = walk(node, identityMtx())
+			if err != nil {
+				return nil, err
+			}
+		}
+	}
+	return
+}
+
+// top-down build, splitting each node along the axis of largest centroid
+// spread at the position with the lowest surface area heuristic cost. nodes are
+// stored depth-first so that a left child always directly follows its parent.
+// nodes at BVH_MAX_DEPTH become leaves regardless of how many items they hold,
+// which bounds the stack the runtime needs to walk the tree
+func buildBVH(items []bvhItem, depth int, nodes *[]BinBVHNode, order *[]BinBVHItem) {
+	idx := len(*nodes)
+	*nodes = append(*nodes, BinBVHNode{})
+
+	bounds := emptyAABB()
+	centroids := emptyAABB()
+	for _, item := range items {
+		bounds = bounds.Union(item.Bounds)
+		centroids = centroids.Union(AABB{Min: item.Centroid, Max: item.Centroid})
+	}
+	(*nodes)[idx].Min = bounds.Min
+	(*nodes)[idx].Max = bounds.Max
+
+	axis := 0
+	for i := range 3 {
+		if centroids.Max[i]-centroids.Min[i] > centroids.Max[axis]-centroids.Min[axis] {
+			axis = i
+		}
+	}
+	if len(items) <= BVH_LEAF_SIZE || depth == BVH_MAX_DEPTH-1 || centroids.Max[axis] == centroids.Min[axis] {
+		(*nodes)[idx].First = uint32(len(*order))
+		(*nodes)[idx].Count = uint32(len(items))
+		for _, item := range items {
+			*order = append(*order, item.BinBVHItem)
+		}
+		return
+	}
+
+	sort.SliceStable(items, func(a, b int) bool {
+		return items[a].Centroid[axis] < items[b].Centroid[axis]
+	})
+	rightArea := make([]float64, len(items))
+	right := emptyAABB()
+	for i := len(items) - 1; i > 0; i-- {
+		right = right.Union(items[i].Bounds)
+		rightArea[i] = right.SurfaceArea()
+	}
+	split := len(items) / 2
+	bestCost := -1.0
+	left := emptyAABB()
+	for i := 1; i < len(items); i++ {
+		left = left.Union(items[i-1].Bounds)
+		cost := left.SurfaceArea()*float64(i) + rightArea[i]*float64(len(items)-i)
+		if bestCost < 0 || cost < bestCost {
+			bestCost = cost
+			split = i
+		}
+	}
+
+	buildBVH(items[:split], depth+1, nodes, order)
+	(*nodes)[idx].First = uint32(len(*nodes))
+	buildBVH(items[split:], depth+1, nodes, order)
+}
+
+func packBVH(model Model, primitiveIdxs map[*gltf.Primitive]int) (err error) {
+	items, err := collectBVHItems(model.Asset, primitiveIdxs)
+	if err != nil {
+		return fmt.Errorf(`failed to collect primitive bounds (%w)`, err)
+	}
+
+	model.Tables.BVHNodes = []BinBVHNode{}
+	model.Tables.BVHItems = []BinBVHItem{}
+	if len(items) > 0 {
+		buildBVH(items, 0, &model.Tables.BVHNodes, &model.Tables.BVHItems)
+	}
+	return
+}
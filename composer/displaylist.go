@@ -0,0 +1,230 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"fmt"
+
+	"github.com/qmuntal/gltf"
+	"github.com/qmuntal/gltf/modeler"
+)
+
+/* GX attribute types (GXAttrType) */
+const (
+	GX_NONE    uint8 = 0
+	GX_DIRECT  uint8 = 1
+	GX_INDEX8  uint8 = 2
+	GX_INDEX16 uint8 = 3
+)
+
+const GX_VTXFMT0 uint8 = 0
+
+// primitives at most this many vertices long that use each vertex once are
+// sent direct by the runtime. must match DIRECT_MAX_VERTICES in runtime/src/render.c
+const GX_DIRECT_MAX_VERTICES int = 32
+const GX_NOP uint8 = 0x00
+
+// GX primitive opcodes, indexed by glTF primitive mode
+var gxPrimitive = map[gltf.PrimitiveMode]uint8{
+	gltf.PrimitivePoints:        0xB8,
+	gltf.PrimitiveLines:         0xA8,
+	gltf.PrimitiveLineStrip:     0xB0,
+	gltf.PrimitiveTriangles:     0x90,
+	gltf.PrimitiveTriangleStrip: 0x98,
+	gltf.PrimitiveTriangleFan:   0xA0,
+}
+
+// GX attribute types of the vertex components stored in a display list, in
+// the order GX expects them in the vertex stream
+type VtxDesc struct {
+	Position  uint8
+	Normal    uint8
+	Color0    uint8
+	TexCoord0 uint8
+}
+
+// returns the accessor the runtime uses for TEX0 of `primitive`, or nil if the
+// primitive is drawn untextured. must mirror has_texture() in render.c
+func texCoordAccessor(primitive *gltf.Primitive) (idx int, ok bool) {
+	if primitive.Material == nil {
+		return 0, false
+	}
+	if idx, ok = primitive.Attributes["TEXCOORD_0"]; ok {
+		return
+	}
+	idx, ok = primitive.Attributes["TEXCOORD_1"]
+	return
+}
+
+func usesEachVertexOnce(indices []uint32, numVertices int) bool {
+	if len(indices) != numVertices || numVertices > GX_DIRECT_MAX_VERTICES {
+		return false
+	}
+	seen := map[uint32]bool{}
+	for _, idx := range indices {
+		if seen[idx] {
+			return false
+		}
+		seen[idx] = true
+	}
+	return true
+}
+
+/*
+an upper bound on the scratch the runtime takes to record the display list of
+a primitive that wasn't baked (compile_primitive in runtime/src/render.c): the
+GX_Begin command and the vertex stream, with each attribute sent direct or as
+an index of up to 16 bits, rounded up to 32B with a block of slack. primitives
+with colors corrected on the CPU aren't recorded
+*/
+func recordedDisplayListSize(doc *gltf.Document, primitive *gltf.Primitive, colors map[int]bool) int {
+	pos, hasPos := primitive.Attributes["POSITION"]
+	if !hasPos {
+		return 0
+	}
+	attrs := []int{pos}
+	if nrm, ok := primitive.Attributes["NORMAL"]; ok {
+		attrs = append(attrs, nrm)
+	}
+	if clr, ok := primitive.Attributes["COLOR_0"]; ok {
+		if doc.Accessors[clr].ComponentType != gltf.ComponentUbyte && !colors[clr] {
+			return 0
+		}
+		attrs = append(attrs, clr)
+	}
+	if tex, ok := texCoordAccessor(primitive); ok {
+		attrs = append(attrs, tex)
+	}
+
+	count := doc.Accessors[pos].Count
+	if primitive.Indices != nil {
+		count = doc.Accessors[*primitive.Indices].Count
+	}
+	vertexSize := 0
+	for _, attr := range attrs {
+		acr := doc.Accessors[attr]
+		vertexSize += max(2, acr.ComponentType.ByteSize()*acr.Type.Components())
+	}
+	return roundUp32(3+vertexSize*count) + 32
+}
+
+/*
+bakes the GX command stream that draws `primitive` (GX_Begin, the per-vertex
+attribute indices, then NOP padding to 32B) so the runtime can hand it to
+GX_CallDispList as-is. the vertex descriptor the stream was encoded for is
+returned alongside it and must be set by the runtime before calling the list.
+returns a nil display list if the primitive can't be baked, in which case
+the runtime falls back to building it on the console. `colors` are the
+accessors packed in a GX color format, as found by colorAccessors.
+*/
+func bakeDisplayList(doc *gltf.Document, primitive *gltf.Primitive, colors map[int]bool) (dl []byte, desc VtxDesc, err error) {
+	pos, hasPos := primitive.Attributes["POSITION"]
+	if !hasPos || primitive.Indices == nil {
+		return nil, desc, nil
+	}
+	opcode, ok := gxPrimitive[primitive.Mode]
+	if !ok {
+		return nil, desc, nil
+	}
+
+	var attrs []int
+	attrs = append(attrs, pos)
+	nrm, hasNrm := primitive.Attributes["NORMAL"]
+	if hasNrm {
+		attrs = append(attrs, nrm)
+	}
+	clr, hasClr := primitive.Attributes["COLOR_0"]
+	if hasClr {
+		/* colors are packed in a GX color format unless the accessor is
+		also used as something else. float and u16 colors left as they are
+		are converted by the CPU every frame and sent direct, so they can't
+		be part of a baked list */
+		if doc.Accessors[clr].ComponentType != gltf.ComponentUbyte && !colors[clr] {
+			return nil, desc, nil
+		}
+		attrs = append(attrs, clr)
+	}
+	tex, hasTex := texCoordAccessor(primitive)
+	if hasTex {
+		attrs = append(attrs, tex)
+	}
+
+	indices, err := modeler.ReadIndices(doc, doc.Accessors[*primitive.Indices], nil)
+	if err != nil {
+		return nil, desc, fmt.Errorf(`failed to read indices (%w)`, err)
+	}
+	if len(indices) > 0xFFFF { // GX_Begin vertex count is 16-bit
+		return nil, desc, nil
+	}
+	/* indexing gains nothing when no vertex is reused. the runtime sends
+	such small primitives' vertex data direct instead, in the format it was
+	packed in */
+	if usesEachVertexOnce(indices, doc.Accessors[pos].Count) {
+		return nil, desc, nil
+	}
+
+	/* every attribute is indexed by the same value, so the widest index
+	decides the width for all of them. an index of all ones makes GX skip
+	the vertex, so it can't be used to address an element */
+	var maxIdx uint32 = 0
+	for _, idx := range indices {
+		maxIdx = max(maxIdx, idx)
+	}
+	for _, attr := range attrs {
+		if uint32(doc.Accessors[attr].Count) <= maxIdx {
+			return nil, desc, fmt.Errorf(`index %d out of range for accessor %d`, maxIdx, attr)
+		}
+	}
+	var width uint8
+	switch {
+	case maxIdx < 0xFF:
+		width = GX_INDEX8
+	case maxIdx < 0xFFFF:
+		width = GX_INDEX16
+	default:
+		return nil, desc, nil
+	}
+
+	desc.Position = width
+	if hasNrm {
+		desc.Normal = width
+	}
+	if hasClr {
+		desc.Color0 = width
+	}
+	if hasTex {
+		desc.TexCoord0 = width
+	}
+
+	dl = append(dl, opcode|GX_VTXFMT0, uint8(len(indices)>>8), uint8(len(indices)))
+	for _, idx := range indices {
+		for range attrs {
+			if width == GX_INDEX8 {
+				dl = append(dl, uint8(idx))
+			} else {
+				dl = append(dl, uint8(idx>>8), uint8(idx))
+			}
+		}
+	}
+	for len(dl)%32 != 0 {
+		dl = append(dl, GX_NOP)
+	}
+
+	return dl, desc, nil
+}
@@ -24,6 +24,7 @@ import (
 	"io/fs"
 	"os"
 	"path/filepath"
+	"slices"
 )
 
 /*
@@ -107,7 +108,10 @@ type FSTEntry struct {
 type FST struct {
 	StringTable []byte
 	FilesBin    []byte
+	OuterBin    []byte // files placed at the end of the disc, directly before the runtime
+	OuterOffset int
 	Entries     []FSTEntry
+	Files       []fstFile // placed into FilesBin and OuterBin by layoutFiles
 }
 
 type GameID struct {
@@ -119,7 +123,7 @@ type GameID struct {
 	GameName    [64]uint8
 }
 
-func recurseFST(state *FST, file os.DirEntry, path string, parentIdx int) (err error) {
+func recurseFST(state *FST, file os.DirEntry, path string, fstPath string, parentIdx int) (err error) {
 	entryIdx := len(state.Entries)
 	state.Entries = append(state.Entries, FSTEntry{})
 
@@ -136,7 +140,11 @@ func recurseFST(state *FST, file os.DirEntry, path string, parentIdx int) (err e
 			return err
 		}
 		for _, child := range dir {
-			err = recurseFST(state, child, filepath.Join(path, child.Name()), entryIdx)
+			childPath := child.Name()
+			if entryIdx != 0 {
+				childPath = fstPath + "/" + childPath
+			}
+			err = recurseFST(state, child, filepath.Join(path, child.Name()), childPath, entryIdx)
 			if err != nil {
 				return err
 			}
@@ -144,23 +152,13 @@ func recurseFST(state *FST, file os.DirEntry, path string, parentIdx int) (err e
 
 		state.Entries[entryIdx].Ident |= (uint32(1) << 24)
 		state.Entries[entryIdx].Offset = uint32(parentIdx)
-		state.Entries[entryIdx].Length = uint32(len(state.Entries) - entryIdx - 1)
+		state.Entries[entryIdx].Length = uint32(len(state.Entries)) // next_offset, or num_entries for the root
 	} else {
-		// all files on disk aligned to 4B
-		state.FilesBin, err = AlignPad(state.FilesBin, 4)
-		if err != nil {
-			return err
-		}
-
-		offset := uint32(len(state.FilesBin))
 		contents, err := os.ReadFile(path)
 		if err != nil {
 			return fmt.Errorf(`failed to read file "%s"`, path)
 		}
-		state.FilesBin = append(state.FilesBin, contents...)
-
-		state.Entries[entryIdx].Offset = offset
-		state.Entries[entryIdx].Length = uint32(len(contents))
+		state.Files = append(state.Files, fstFile{Entry: entryIdx, Path: fstPath, Contents: contents})
 	}
 
 	return
@@ -174,13 +172,11 @@ func buildFST(rootPath string) (fst *FST, err error) {
 		return nil, fmt.Errorf(`failed to stat FST root dir (%w)`, err)
 	}
 	state := new(FST)
-	err = recurseFST(state, fs.FileInfoToDirEntry(dir), rootPath, 0)
+	err = recurseFST(state, fs.FileInfoToDirEntry(dir), rootPath, "", 0)
 	if err != nil {
 		return nil, fmt.Errorf(`failed to build FST (%w)`, err)
 	}
 
-	state.Entries[0].Length += 1 // FST root entry includes itself in length
-
 	state.StringTable, err = AlignPad(state.StringTable, 4)
 	if err != nil {
 		return nil, err
@@ -198,7 +194,8 @@ func patchFSTAddrs(fstState FST, filesOffset int) {
 	}
 }
 
-func GCM(id GameID, apploaderPath string, dolPath string, fstRootPath string) (gcm []byte, err error) {
+func GCM(id GameID, apploaderPath string, dolPath string, fstRootPath string, layout Layout, order []string) (
+	gcm []byte, err error) {
 	fmt.Println("Building GCM disc image")
 
 	gcm = AppendOrPanic(gcm, binary.BigEndian, DiscSystemArea{})
@@ -218,24 +215,37 @@ func GCM(id GameID, apploaderPath string, dolPath string, fstRootPath string) (g
 	}
 	fstSize := PackedSize(fstState.Entries) + len(fstState.StringTable)
 
+	dol, err := os.ReadFile(dolPath)
+	if err != nil {
+		return nil, err
+	}
+
 	/*
-	 * Game files are placed sequentially, directly after the FST.
-	 * This is fine for random access storage such as SD cards, but
-	 * could probably be optimized for optical media to determine file
-	 * placement according to location on disc.
+	 * Game files start at the first ECC block after the FST, placed in
+	 * the order given by the layout. See layoutFiles.
 	 */
-	patchFSTAddrs(*fstState, len(gcm)+fstSize)
-
 	fstOffset := len(gcm)
+	filesOffset := (fstOffset + fstSize + DVD_ECC_BLOCK_SIZE - 1) / DVD_ECC_BLOCK_SIZE * DVD_ECC_BLOCK_SIZE
+	err = layoutFiles(fstState, filesOffset, layout, order, len(dol))
+	if err != nil {
+		return nil, fmt.Errorf(`failed to lay out files (%w)`, err)
+	}
+	patchFSTAddrs(*fstState, filesOffset)
+
 	gcm = AppendOrPanic(gcm, binary.BigEndian, fstState.Entries)
 	gcm = AppendOrPanic(gcm, binary.BigEndian, fstState.StringTable)
+	gcm = append(gcm, make([]byte, filesOffset-len(gcm))...)
 	gcm = AppendOrPanic(gcm, binary.BigEndian, fstState.FilesBin)
+	if fstState.OuterBin != nil {
+		// grown in place, as the image is as large as the disc
+		gcm = slices.Grow(gcm, fstState.OuterOffset+len(fstState.OuterBin)+len(dol)-len(gcm))
+		start := len(gcm)
+		gcm = gcm[:fstState.OuterOffset]
+		clear(gcm[start:])
+		gcm = append(gcm, fstState.OuterBin...)
+	}
 
 	dolOffset := len(gcm)
-	dol, err := os.ReadFile(dolPath)
-	if err != nil {
-		return nil, err
-	}
 	gcm = AppendOrPanic(gcm, binary.BigEndian, dol)
 
 	/*
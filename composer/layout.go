@@ -0,0 +1,168 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"sort"
+	"strings"
+)
+
+const DVD_ECC_BLOCK_SIZE int = 0x8000 // 32KiB (16 sectors), the smallest unit the drive reads and corrects at once
+const GCM_DISC_SIZE int = 1459978240  // capacity of a GameCube disc
+
+/*
+ * Controls where files are placed on the disc. Files named by the access
+ * profile (Order, or the paths listed in Trace) are placed contiguously in the
+ * order they were first read, so that a level load streams forward instead of
+ * seeking. Paths are relative to the FST root, e.g. "~default.PAK".
+ */
+type Layout struct {
+	Order []string // files in the order they are read, first read first
+	Trace string   // text file listing files in the order they were read, one per line (`orca trace --order` writes one)
+	// place the profiled files and the runtime at the end of the disc, where
+	// the drive reads fastest. grows the image to the full size of a disc
+	OuterEdge bool
+}
+
+type fstFile struct {
+	Entry    int    // index into FST.Entries
+	Path     string // relative to the FST root, separated by "/"
+	Contents []byte
+}
+
+// reads a list of FST paths, ignoring blank lines and lines starting with "#"
+func readAccessProfile(name string) (order []string, err error) {
+	f, err := os.Open(name)
+	if err != nil {
+		return nil, fmt.Errorf(`failed to open access profile (%w)`, err)
+	}
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		order = append(order, line)
+	}
+	if err = scanner.Err(); err != nil {
+		return nil, fmt.Errorf(`failed to read access profile (%w)`, err)
+	}
+	return
+}
+
+// first position each file appears at in the access profile
+func profileRanks(files []fstFile, order []string) map[string]int {
+	known := map[string]bool{}
+	for _, file := range files {
+		known[file.Path] = true
+	}
+
+	ranks := map[string]int{}
+	for _, path := range order {
+		path = strings.TrimPrefix(strings.ReplaceAll(path, "\\", "/"), "/")
+		if !known[path] {
+			fmt.Printf("Warning: access profile names \"%s\", which is not on the disc\n", path)
+			continue
+		}
+		if _, ok := ranks[path]; !ok {
+			ranks[path] = len(ranks)
+		}
+	}
+	return ranks
+}
+
+// files of at least one ECC block start on an ECC block boundary, so reading
+// them never pulls in a partial block belonging to a neighbour
+func fileAlignment(size int) uint {
+	if size >= DVD_ECC_BLOCK_SIZE {
+		return uint(DVD_ECC_BLOCK_SIZE)
+	}
+	return 4
+}
+
+func appendFiles(bin []byte, files []fstFile, state *FST) (out []byte, err error) {
+	out = bin
+	for _, file := range files {
+		out, err = AlignPad(out, fileAlignment(len(file.Contents)))
+		if err != nil {
+			return nil, err
+		}
+		state.Entries[file.Entry].Offset = uint32(len(out))
+		state.Entries[file.Entry].Length = uint32(len(file.Contents))
+		out = append(out, file.Contents...)
+	}
+	return
+}
+
+/*
+ * Builds state.FilesBin, which is placed on the disc at filesOffset (aligned to
+ * an ECC block), and state.OuterBin if the layout uses the outer edge, which is
+ * followed by `trailing` bytes (the runtime). Unprofiled files keep their
+ * directory order, so files of the same folder stay together.
+ */
+func layoutFiles(state *FST, filesOffset int, layout Layout, order []string, trailing int) (err error) {
+	ranks := profileRanks(state.Files, order)
+	hot := []fstFile{}
+	cold := []fstFile{}
+	for _, file := range state.Files {
+		if _, ok := ranks[file.Path]; ok {
+			hot = append(hot, file)
+		} else {
+			cold = append(cold, file)
+		}
+	}
+	sort.SliceStable(hot, func(a, b int) bool {
+		return ranks[hot[a].Path] < ranks[hot[b].Path]
+	})
+
+	if !layout.OuterEdge {
+		state.FilesBin, err = appendFiles(nil, append(hot, cold...), state)
+		return
+	}
+
+	state.FilesBin, err = appendFiles(nil, cold, state)
+	if err != nil {
+		return
+	}
+	block, err := appendFiles(nil, hot, state) // offsets relative to the block for now
+	if err != nil {
+		return
+	}
+	block, err = AlignPad(block, 32)
+	if err != nil {
+		return
+	}
+
+	end := GCM_DISC_SIZE - (trailing+31)/32*32
+	start := (end - len(block)) / DVD_ECC_BLOCK_SIZE * DVD_ECC_BLOCK_SIZE
+	if start < filesOffset+len(state.FilesBin) {
+		return fmt.Errorf(`files do not fit on the disc`)
+	}
+	for _, file := range hot {
+		state.Entries[file.Entry].Offset += uint32(start - filesOffset)
+	}
+	state.OuterBin = append(block, make([]byte, end-start-len(block))...)
+	state.OuterOffset = start
+	return
+}
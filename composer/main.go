@@ -23,6 +23,7 @@ import "github.com/alecthomas/kong"
 var cli struct {
 	Build BuildCmd `cmd:"" help:"Build a project"`
 	Init  InitCmd  `cmd:"" help:"Initialize a new project"`
+	Trace TraceCmd `cmd:"" help:"Summarize DVD reads recorded by the runtime"`
 }
 
 func main() {
@@ -0,0 +1,450 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"fmt"
+	"math"
+	"reflect"
+	"slices"
+
+	"github.com/qmuntal/gltf"
+	"github.com/qmuntal/gltf/modeler"
+)
+
+// tuning of Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring. the
+// simulated cache only needs to be roughly the size of the real one, an order
+// made for a larger cache still does well on a smaller one
+const FORSYTH_CACHE_SIZE int = 32
+const FORSYTH_CACHE_DECAY_POWER float64 = 1.5
+const FORSYTH_LAST_TRI_SCORE float64 = 0.75
+const FORSYTH_VALENCE_BOOST_SCALE float64 = 2.0
+const FORSYTH_VALENCE_BOOST_POWER float64 = 0.5
+
+// how much emitting a triangle that uses a vertex is worth, given where the
+// vertex is in the cache (-1 if it isn't) and how many triangles still use it
+func forsythVertexScore(cachePos int, remaining int) float64 {
+	if remaining == 0 {
+		return -1
+	}
+	score := 0.0
+	switch {
+	case cachePos < 0:
+	case cachePos < 3: // used by the last triangle, whichever way round it goes
+		score = FORSYTH_LAST_TRI_SCORE
+	default:
+		scaled := 1 - float64(cachePos-3)/float64(FORSYTH_CACHE_SIZE-3)
+		score = math.Pow(scaled, FORSYTH_CACHE_DECAY_POWER)
+	}
+	// favour vertices with few triangles left, so they leave the cache sooner
+	return score + FORSYTH_VALENCE_BOOST_SCALE*math.Pow(float64(remaining), -FORSYTH_VALENCE_BOOST_POWER)
+}
+
+// reorders the triangles of a triangle list so that consecutive triangles
+// reuse the vertices most recently transformed
+func forsythOrder(indices []uint32, numVertices int) (out []uint32) {
+	numTris := len(indices) / 3
+
+	/* triangles using each vertex. the first `remaining[v]` entries from
+	offsets[v] are the triangles that haven't been emitted yet */
+	offsets := make([]int, numVertices+1)
+	for _, v := range indices[:numTris*3] {
+		offsets[v+1]++
+	}
+	for v := range numVertices {
+		offsets[v+1] += offsets[v]
+	}
+	adjacency := make([]int, numTris*3)
+	remaining := make([]int, numVertices)
+	for i, v := range indices[:numTris*3] {
+		adjacency[offsets[v]+remaining[v]] = i / 3
+		remaining[v]++
+	}
+
+	cachePos := make([]int, numVertices)
+	score := make([]float64, numVertices)
+	for v := range numVertices {
+		cachePos[v] = -1
+		score[v] = forsythVertexScore(-1, remaining[v])
+	}
+	triScore := func(t int) float64 {
+		return score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]]
+	}
+
+	emitted := make([]bool, numTris)
+	best, bestScore := -1, -1.0
+	for t := range numTris {
+		if s := triScore(t); s > bestScore {
+			best, bestScore = t, s
+		}
+	}
+	cache := []uint32{}
+	next := 0 // where to look for a triangle once none is next to the cache
+	out = make([]uint32, 0, numTris*3)
+	for len(out) < numTris*3 {
+		if best < 0 {
+			for emitted[next] {
+				next++
+			}
+			best = next
+		}
+		tri := indices[best*3 : best*3+3]
+		out = append(out, tri...)
+		emitted[best] = true
+
+		for _, v := range tri {
+			live := adjacency[offsets[v] : offsets[v]+remaining[v]]
+			if i := slices.Index(live, best); i >= 0 {
+				live[i], live[len(live)-1] = live[len(live)-1], live[i]
+				remaining[v]--
+			}
+		}
+
+		/* the triangle's vertices move to the front of the cache, pushing
+		the least recently used ones out of the end */
+		touched := []uint32{}
+		for _, v := range tri {
+			if !slices.Contains(touched, v) {
+				touched = append(touched, v)
+			}
+		}
+		for _, v := range cache {
+			if !slices.Contains(tri, v) {
+				touched = append(touched, v)
+			}
+		}
+		for i, v := range touched {
+			if i < FORSYTH_CACHE_SIZE {
+				cachePos[v] = i
+			} else {
+				cachePos[v] = -1
+			}
+			score[v] = forsythVertexScore(cachePos[v], remaining[v])
+		}
+		cache = touched[:min(len(touched), FORSYTH_CACHE_SIZE)]
+
+		best, bestScore = -1, -1.0
+		for _, v := range touched {
+			for _, t := range adjacency[offsets[v] : offsets[v]+remaining[v]] {
+				if s := triScore(t); s > bestScore {
+					best, bestScore = t, s
+				}
+			}
+		}
+	}
+	return
+}
+
+// new index of each vertex, numbered in the order the triangles first use
+// them so that attribute fetches walk forward through memory. vertices no
+// triangle uses keep their order after the rest
+func fetchOrder(indices []uint32, numVertices int) (remap []uint32) {
+	remap = make([]uint32, numVertices)
+	for v := range remap {
+		remap[v] = UINT32_MAX
+	}
+	var n uint32 = 0
+	for _, v := range indices {
+		if remap[v] == UINT32_MAX {
+			remap[v] = n
+			n++
+		}
+	}
+	for v := range remap {
+		if remap[v] == UINT32_MAX {
+			remap[v] = n
+			n++
+		}
+	}
+	return
+}
+
+/*
+converts a triangle list to a single triangle strip. separate strips are
+joined by repeating vertices, which makes degenerate triangles GX draws
+nothing for, rather than by restarting the primitive. each strip starts at
+the earliest triangle left and grows with the earliest triangle sharing its
+last edge, so a cache optimized order mostly survives
+*/
+func stripify(indices []uint32) (strip []uint32) {
+	numTris := len(indices) / 3
+	edgeKey := func(a, b uint32) uint64 { return uint64(a)<<32 | uint64(b) }
+
+	// triangles with each directed edge, in list order
+	edges := map[uint64][]int{}
+	for t := range numTris {
+		for i := range 3 {
+			key := edgeKey(indices[t*3+i], indices[t*3+(i+1)%3])
+			edges[key] = append(edges[key], t)
+		}
+	}
+	used := make([]bool, numTris)
+	// the earliest triangle left with the directed edge a->b, and its third vertex
+	follow := func(a, b uint32) (t int, c uint32, ok bool) {
+		for _, t := range edges[edgeKey(a, b)] {
+			if used[t] {
+				continue
+			}
+			for i := range 3 {
+				if indices[t*3+i] == a && indices[t*3+(i+1)%3] == b {
+					return t, indices[t*3+(i+2)%3], true
+				}
+			}
+		}
+		return 0, 0, false
+	}
+
+	for start := range numTris {
+		if used[start] {
+			continue
+		}
+		used[start] = true
+		tri := indices[start*3 : start*3+3]
+
+		/* start on the rotation that lets a second triangle follow. strip
+		triangles alternate winding, so the second one shares the first's
+		last edge reversed */
+		s := []uint32{tri[0], tri[1], tri[2]}
+		for r := range 3 {
+			a, b, c := tri[r], tri[(r+1)%3], tri[(r+2)%3]
+			if _, _, ok := follow(c, b); ok {
+				s = []uint32{a, b, c}
+				break
+			}
+		}
+		for {
+			n := len(s)
+			a, b := s[n-2], s[n-1]
+			if n%2 != 0 { // the next triangle is odd
+				a, b = b, a
+			}
+			t, c, ok := follow(a, b)
+			if !ok {
+				break
+			}
+			used[t] = true
+			s = append(s, c)
+		}
+
+		if len(strip) > 0 {
+			strip = append(strip, strip[len(strip)-1], s[0])
+			// the strip's first triangle must land on an even triangle to keep its winding
+			if len(strip)%2 != 0 {
+				strip = append(strip, s[0])
+			}
+		}
+		strip = append(strip, s...)
+	}
+	return
+}
+
+// whether anything other than accessor `except` reads bufferView `view`
+func bufferViewUsed(doc *gltf.Document, view int, except int) bool {
+	for i, acr := range doc.Accessors {
+		if i == except {
+			continue
+		}
+		if acr.BufferView != nil && *acr.BufferView == view {
+			return true
+		}
+		if acr.Sparse != nil && (acr.Sparse.Indices.BufferView == view || acr.Sparse.Values.BufferView == view) {
+			return true
+		}
+	}
+	for _, img := range doc.Images {
+		if img.BufferView != nil && *img.BufferView == view {
+			return true
+		}
+	}
+	return false
+}
+
+// removes bufferView `view` and its bytes, which nothing may read. the views
+// after it in its buffer move down by a multiple of 4, keeping their alignment,
+// so up to 3 of its bytes are left behind
+func removeBufferView(doc *gltf.Document, view int) {
+	removed := doc.BufferViews[view]
+	buffer := doc.Buffers[removed.Buffer]
+	start, shift := removed.ByteOffset, removed.ByteLength&^3
+	for _, bv := range doc.BufferViews {
+		if bv.Buffer == removed.Buffer && bv != removed && bv.ByteOffset >= start+removed.ByteLength {
+			bv.ByteOffset -= shift
+		}
+	}
+	buffer.Data = append(buffer.Data[:start], buffer.Data[start+shift:]...)
+	buffer.ByteLength = len(buffer.Data)
+
+	doc.BufferViews = slices.Delete(doc.BufferViews, view, view+1)
+	renumber := func(v *int) {
+		if *v > view {
+			*v--
+		}
+	}
+	for _, acr := range doc.Accessors {
+		if acr.BufferView != nil {
+			renumber(acr.BufferView)
+		}
+		if acr.Sparse != nil {
+			renumber(&acr.Sparse.Indices.BufferView)
+			renumber(&acr.Sparse.Values.BufferView)
+		}
+	}
+	for _, img := range doc.Images {
+		if img.BufferView != nil {
+			renumber(img.BufferView)
+		}
+	}
+}
+
+/*
+replaces the contents of accessor `idx`, keeping its index and properties.
+when nothing else reads the accessor's old bufferView, the new data is moved
+into it if it fits, or the old view is removed, so replaced data doesn't stay
+in the document as well
+*/
+func replaceAccessor(doc *gltf.Document, idx int, target gltf.Target, data any) {
+	n := modeler.WriteAccessor(doc, target, data)
+	old, acr := doc.Accessors[idx], doc.Accessors[n]
+	acr.Name = old.Name
+	acr.Normalized = old.Normalized
+	doc.Accessors[idx] = acr
+	doc.Accessors = doc.Accessors[:n]
+
+	if old.BufferView == nil || old.Sparse != nil || bufferViewUsed(doc, *old.BufferView, idx) {
+		return
+	}
+	oldView, newView := doc.BufferViews[*old.BufferView], doc.BufferViews[*acr.BufferView]
+	if newView.ByteLength > oldView.ByteLength {
+		removeBufferView(doc, *old.BufferView)
+		return
+	}
+	// the new view was written last, at the end of its buffer
+	buffer := doc.Buffers[newView.Buffer]
+	copy(doc.Buffers[oldView.Buffer].Data[oldView.ByteOffset:], buffer.Data[newView.ByteOffset:newView.ByteOffset+newView.ByteLength])
+	buffer.Data = buffer.Data[:newView.ByteOffset]
+	buffer.ByteLength = len(buffer.Data)
+	oldView.ByteLength = newView.ByteLength
+	oldView.ByteStride = newView.ByteStride
+	oldView.Target = newView.Target
+	doc.BufferViews = doc.BufferViews[:*acr.BufferView]
+	acr.BufferView = old.BufferView
+}
+
+// moves each element of vertex attribute accessor `idx` to its index in `remap`
+func reorderAccessor(doc *gltf.Document, idx int, remap []uint32) (err error) {
+	contents, err := modeler.ReadAccessor(doc, doc.Accessors[idx], nil)
+	if err != nil {
+		return fmt.Errorf(`failed to read accessor (%w)`, err)
+	}
+	src := reflect.ValueOf(contents)
+	dst := reflect.MakeSlice(src.Type(), src.Len(), src.Len())
+	for v := range src.Len() {
+		dst.Index(int(remap[v])).Set(src.Index(v))
+	}
+
+	lower, upper := doc.Accessors[idx].Min, doc.Accessors[idx].Max // unchanged by reordering
+	replaceAccessor(doc, idx, gltf.TargetArrayBuffer, dst.Interface())
+	doc.Accessors[idx].Min, doc.Accessors[idx].Max = lower, upper
+	return
+}
+
+/*
+reorders the triangles of each indexed triangle list for the post-transform
+vertex cache, then renumbers its vertices in the order they're first used.
+with `strips`, the list is also converted to a triangle strip when that takes
+fewer indices. vertices shared with another primitive can't be renumbered, so
+those primitives only have their triangles reordered. runs after
+splitPrimitives, so primitives that had uint32 indices are optimized batch by
+batch like the rest.
+*/
+func optimizeMeshes(doc *gltf.Document, strips bool) (err error) {
+	primitives := []*gltf.Primitive{}
+	uses := map[int]int{}
+	for _, mesh := range doc.Meshes {
+		for _, primitive := range mesh.Primitives {
+			if slices.Contains(primitives, primitive) {
+				continue
+			}
+			primitives = append(primitives, primitive)
+			for _, idx := range primitive.Attributes {
+				uses[idx]++
+			}
+			for _, target := range primitive.Targets {
+				for _, idx := range target {
+					uses[idx]++
+				}
+			}
+			if primitive.Indices != nil {
+				uses[*primitive.Indices]++
+			}
+		}
+	}
+
+	for _, primitive := range primitives {
+		pos, ok := primitive.Attributes["POSITION"]
+		if primitive.Mode != gltf.PrimitiveTriangles || primitive.Indices == nil || !ok {
+			continue
+		}
+		if uses[*primitive.Indices] != 1 {
+			continue
+		}
+		indices, err := modeler.ReadIndices(doc, doc.Accessors[*primitive.Indices], nil)
+		if err != nil {
+			return fmt.Errorf(`failed to read indices (%w)`, err)
+		}
+		numVertices := doc.Accessors[pos].Count
+		if slices.ContainsFunc(indices, func(v uint32) bool { return int(v) >= numVertices }) {
+			continue // reported when the display list is baked
+		}
+
+		indices = forsythOrder(indices, numVertices)
+
+		exclusive := len(primitive.Targets) == 0
+		for _, idx := range primitive.Attributes {
+			exclusive = exclusive && uses[idx] == 1 && doc.Accessors[idx].Count == numVertices
+		}
+		if exclusive {
+			remap := fetchOrder(indices, numVertices)
+			for _, idx := range primitive.Attributes {
+				err = reorderAccessor(doc, idx, remap)
+				if err != nil {
+					return err
+				}
+			}
+			for i, v := range indices {
+				indices[i] = remap[v]
+			}
+		}
+
+		if strips {
+			if strip := stripify(indices); len(strip) < len(indices) {
+				indices = strip
+				primitive.Mode = gltf.PrimitiveTriangleStrip
+			}
+		}
+
+		// splitPrimitives has already made every index fit in 16 bits, which is what the runtime reads
+		out := make([]uint16, len(indices))
+		for i, v := range indices {
+			out[i] = uint16(v)
+		}
+		replaceAccessor(doc, *primitive.Indices, gltf.TargetElementArrayBuffer, out)
+	}
+	return
+}
@@ -19,14 +19,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 package main
 
 import (
-	"bytes"
 	"encoding/binary"
 	"fmt"
-	"image"
-	_ "image/jpeg"
-	_ "image/png"
+	"math"
 	"path/filepath"
 	"reflect"
+	"slices"
+	"strings"
 
 	"github.com/qmuntal/gltf"
 	gltf_binary "github.com/qmuntal/gltf/binary"
@@ -35,12 +34,16 @@ import (
 
 const UINT32_MAX uint32 = ^uint32(0)
 
+const PAK_VERSION uint16 = 11
+
 type BinPakHeader struct {
-	Signature         uint32
+	Signature         [2]uint8
+	Version           uint16
 	StringTableLength uint32
 	StringTableOffset uint32
 	DirectoryCount    uint32
 	DirectoryOffset   uint32
+	ScratchSize       uint32 // see Pak.Scratch
 }
 
 type BinDirectoryEntry struct {
@@ -48,93 +51,195 @@ type BinDirectoryEntry struct {
 	Offset uint32
 	Type   uint8
 	_      [3]uint8
+	Length uint32
 }
 
-type BinModelDirectory struct {
-	IndexTableCount      uint32
-	IndexTableOffset     uint32
-	NodeTableCount       uint32
-	NodeTableOffset      uint32
-	MeshTableCount       uint32
-	MeshTableOffset      uint32
-	MaterialTableCount   uint32
-	MaterialTableOffset  uint32
-	PrimitiveTableCount  uint32
-	PrimitiveTableOffset uint32
-	AccessorTableCount   uint32
-	AccessorTableOffset  uint32
-	SceneTableCount      uint32
-	SceneTableOffset     uint32
+/*
+the records below are the runtime's structs (runtime/include/pak.h) as they
+are laid out on the console, so that a model's tables can be used where they
+are read. pointer fields hold string table offsets, offsets from the start of
+the model, table indices (UINT32_MAX for NULL) or PAK file offsets, and the
+runtime fixes them up in place. enums hold the GX values the runtime uses.
+*/
+
+// struct Model, followed in the PAK by the tables it points to
+type BinModel struct {
+	Idxs             uint32 // offsets from the start of the model
+	Nodes            uint32
+	Meshes           uint32
+	Materials        uint32
+	Primitives       uint32
+	Accessors        uint32
+	Scenes           uint32
+	BVHNodes         uint32
+	BVHItems         uint32
+	NumIdxs          uint32
+	NumNodes         uint32
+	NumMeshes        uint32
+	NumMaterials     uint32
+	NumPrimitives    uint32
+	NumAccessors     uint32
+	NumScenes        uint32
+	NumBVHNodes      uint32
+	NumBVHItems      uint32
+	DisplayLists     uint32 // PAK file offset
+	DisplayListsSize uint32
+	_                [4]uint8 // runtime state
 }
 
 type BinScene struct {
 	Name       uint32
+	Nodes      uint32 // index into index table
 	NodesCount uint32
-	Nodes      uint32
 }
 
 type BinAccessor struct {
-	Name          uint32
-	BufferOffset  uint32
-	Count         uint32
-	ComponentType uint8
-	ElementType   uint8
-	_             [2]uint8
+	Name            uint32
+	Buffer          uint32 // PAK file offset, or offset within the record if interleaved
+	InterleavedWith uint32 // index of the accessor owning the stream, UINT32_MAX if not interleaved
+	CompressedSize  uint32 // of the Yaz0 stream at Buffer, 0 if stored raw
+	Count           uint32
+	Stride          uint32
+	ComponentType   uint32
+	ElementType     uint32
+	Frac            uint8 // fractional bits of fixed point S8/S16 components
+	ColorFormat     uint8 // GX color format of COMPONENT_COLOR components
+	_               [2]uint8
 }
 
 type BinMaterial struct {
-	Name                   uint32
-	BaseColorTextureOffset uint32
-	BaseColorTextureLength uint32
-	Width                  uint16
-	Height                 uint16
-	TexCoord               uint8
-	Format                 uint8
-	WrapS                  uint8
-	WrapT                  uint8
+	Name           uint32
+	_              [4]uint8 // runtime state
+	Image          uint32   // PAK file offset
+	ImageSize      uint32
+	CompressedSize uint32 // of the Yaz0 stream at Image, 0 if stored raw
+	Width          uint16
+	Height         uint16
+	WrapS          uint32
+	WrapT          uint32
+	Format         uint32
+	TexCoord       uint8
+	_              [3]uint8
 }
 
 type BinMeshPrimitive struct {
-	AttrPos      uint32
-	AttrNormal   uint32
-	AttrTangent  uint32
-	AttrSt0      uint32
-	AttrSt1      uint32
-	AttrVc0      uint32
-	AttrJoints0  uint32
-	AttrWeights0 uint32
-	Indices      uint32
-	Material     uint32
-	Mode         uint8
-	_            [3]uint8
+	AttrPos         uint32 // indices into accessor table
+	AttrNormal      uint32
+	AttrTangent     uint32
+	AttrSt0         uint32
+	AttrSt1         uint32
+	AttrVc0         uint32
+	AttrJoints0     uint32
+	AttrWeights0    uint32
+	Indices         uint32
+	Material        uint32 // index into material table
+	Mode            uint32
+	DisplayList     uint32 // offset into display list table, UINT32_MAX if not baked
+	DisplayListSize uint32
+	VtxDesc         VtxDesc
+	BoundsMin       [3]float32 // POSITION bounding box in mesh space
+	BoundsMax       [3]float32
 }
 
 type BinMesh struct {
 	Name            uint32
+	Primitives      uint32 // index into index table
 	PrimitivesCount uint32
-	Primitives      uint32
 }
 
 type BinNode struct {
 	Name          uint32
-	Rotation      [4]float32
+	Mesh          uint32 // index into mesh table
+	Parent        uint32 // index into node table
+	Children      uint32 // index into index table
+	ChildrenCount uint32
+	Rotation      [4]float32 // quaternion rotation (x,y,z,w)
 	Scale         [3]float32
 	Translation   [3]float32
-	ChildrenCount uint32
-	Children      uint32
-	Mesh          uint32
+	BoundsCenter  [3]float32 // sphere around the node's mesh in node space
+	BoundsRadius  float32    // negative if the node has no mesh
+	_             [168]uint8 // runtime state (flags, world bounds and cached matrices)
+}
+
+/* GX component types (GXCompType), plus the runtime's COMPONENT_U32 and COMPONENT_COLOR */
+const (
+	GX_U8           uint32 = 0
+	GX_S8           uint32 = 1
+	GX_U16          uint32 = 2
+	GX_S16          uint32 = 3
+	GX_F32          uint32 = 4
+	COMPONENT_U32   uint32 = 5
+	COMPONENT_COLOR uint32 = 6 // packed in a GX color format
+)
+
+/* GX color formats (GXCompType of color attributes) */
+const (
+	GX_RGB565 uint8 = 0
+	GX_RGB8   uint8 = 1
+	GX_RGBX8  uint8 = 2
+	GX_RGBA4  uint8 = 3
+	GX_RGBA6  uint8 = 4
+	GX_RGBA8  uint8 = 5
+)
+
+/* GX texture wrap modes (GXTexWrapMode) */
+const (
+	GX_CLAMP  uint32 = 0
+	GX_REPEAT uint32 = 1
+	GX_MIRROR uint32 = 2
+)
+
+// the tables of a model, written out together by packModel
+type ModelTables struct {
+	Nodes      []BinNode
+	Meshes     []BinMesh
+	Materials  []BinMaterial
+	Primitives []BinMeshPrimitive
+	Accessors  []BinAccessor
+	Scenes     []BinScene
+	BVHNodes   []BinBVHNode
+	BVHItems   []BinBVHItem
 }
 
 type Model struct {
 	Asset      *gltf.Document
-	Directory  *BinModelDirectory
+	Header     *BinModel
 	IndexTable *[]uint32
+	Tables     *ModelTables
 }
 
 type Pak struct {
 	Buffer      *[]byte
 	Directory   *[]BinDirectoryEntry
 	StringTable *[]byte
+	Compress    bool
+	Quantize    Quantization
+	Interleave  bool
+	Textures    TextureFormats
+	// scratch the runtime allocates as it loads the level from a whole image
+	// of the file, which it checks is free before reading the file at once
+	Scratch *uint32
+}
+
+// appends bulk data read separately from the model's tables, compressed if
+// that is enabled, makes it smaller and lets the runtime decompress it in place
+func appendBlob(pak Pak, alignment uint, contents any) (offset uint32, compressedSize uint32, err error) {
+	*pak.Buffer, err = AlignPad(*pak.Buffer, alignment)
+	if err != nil {
+		return 0, 0, err
+	}
+	offset = uint32(len(*pak.Buffer))
+	raw := AppendOrPanic(nil, binary.BigEndian, contents)
+	if pak.Compress {
+		stream := yaz0Compress(raw)
+		if roundUp32(len(stream)) < roundUp32(len(raw)) && yaz0DecodesInPlace(stream, len(raw)) {
+			*pak.Buffer = append(*pak.Buffer, stream...)
+			*pak.Scratch += uint32(roundUp32(len(raw))) // decompressed out of the image
+			return offset, uint32(len(stream)), nil
+		}
+	}
+	*pak.Buffer = append(*pak.Buffer, raw...)
+	return offset, 0, nil
 }
 
 func packScenes(model Model, pak Pak) (err error) {
@@ -156,21 +261,24 @@ func packScenes(model Model, pak Pak) (err error) {
 		})
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-	if err != nil {
-		return err
-	}
-	model.Directory.SceneTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.SceneTableCount = uint32(len(scenes))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, scenes)
-
+	model.Tables.Scenes = scenes
 	return
 }
 
 func packNodes(model Model, pak Pak) (err error) {
 	var nodes []BinNode = []BinNode{}
 
-	for _, node := range model.Asset.Nodes {
+	parents := make([]uint32, len(model.Asset.Nodes))
+	for i := range parents {
+		parents[i] = UINT32_MAX
+	}
+	for i, node := range model.Asset.Nodes {
+		for _, child := range node.Children {
+			parents[child] = uint32(i)
+		}
+	}
+
+	for i, node := range model.Asset.Nodes {
 		name := uint32(len(*pak.StringTable))
 		*pak.StringTable = append(*pak.StringTable, ToCString(node.Name)...)
 
@@ -180,9 +288,15 @@ func packNodes(model Model, pak Pak) (err error) {
 		}
 
 		mesh := UINT32_MAX
+		bounds := emptyAABB()
 		if node.Mesh != nil {
 			mesh = uint32(*node.Mesh)
+			bounds, err = meshBounds(model.Asset, model.Asset.Meshes[*node.Mesh])
+			if err != nil {
+				return err
+			}
 		}
+		boundsCenter, boundsRadius := bounds.Sphere()
 
 		// TODO: Matrix decomposition
 		rotation := node.RotationOrDefault()
@@ -209,17 +323,13 @@ func packNodes(model Model, pak Pak) (err error) {
 			ChildrenCount: uint32(len(node.Children)),
 			Children:      children,
 			Mesh:          mesh,
+			Parent:        parents[i],
+			BoundsCenter:  boundsCenter,
+			BoundsRadius:  boundsRadius,
 		})
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-	if err != nil {
-		return err
-	}
-	model.Directory.NodeTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.NodeTableCount = uint32(len(nodes))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, nodes)
-
+	model.Tables.Nodes = nodes
 	return
 }
 
@@ -246,19 +356,13 @@ func packMeshes(model Model, pak Pak, idxs map[*gltf.Primitive]int) (err error)
 		})
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-	if err != nil {
-		return err
-	}
-	model.Directory.MeshTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.MeshTableCount = uint32(len(meshes))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, meshes)
-
+	model.Tables.Meshes = meshes
 	return
 }
 
 func packPrimitives(model Model, pak Pak) (idxs map[*gltf.Primitive]int, err error) {
 	var primitives []BinMeshPrimitive = []BinMeshPrimitive{}
+	var displayLists []byte = []byte{}
 
 	/* qmuntal/gltf doesn't supply a document.MeshPrimitives table,
 	so instead we must traverse all meshes and their primitives;
@@ -266,6 +370,7 @@ func packPrimitives(model Model, pak Pak) (idxs map[*gltf.Primitive]int, err err
 	primitive to make sure we're not adding one that was already done.
 	also store the index so it can be retrieved later from a *gltf.Primitive */
 	idxs = map[*gltf.Primitive]int{}
+	colors := colorAccessors(model.Asset)
 
 	for _, mesh := range model.Asset.Meshes {
 		for _, primitive := range mesh.Primitives {
@@ -295,8 +400,8 @@ func packPrimitives(model Model, pak Pak) (idxs map[*gltf.Primitive]int, err err
 			var indices uint32 = UINT32_MAX
 			if primitive.Indices != nil {
 				indices = uint32(*primitive.Indices)
-				if model.Asset.Accessors[*primitive.Indices].ComponentType == gltf.ComponentUint {
-					return nil, fmt.Errorf(`indices accessor component type must not be uint32`)
+				if model.Asset.Accessors[*primitive.Indices].ComponentType != gltf.ComponentUshort {
+					return nil, fmt.Errorf(`indices accessor component type must be uint16`) // see splitPrimitives()
 				}
 			}
 			var material uint32 = UINT32_MAX
@@ -304,107 +409,95 @@ func packPrimitives(model Model, pak Pak) (idxs map[*gltf.Primitive]int, err err
 				material = uint32(*primitive.Material)
 			}
 
-			/* the enum values provided by qmuntal/gltf
-			do not correspond to the values in the gltf spec :(
-			...map them back to the correct values */
-			mode := map[gltf.PrimitiveMode]uint8{
-				gltf.PrimitivePoints:        0,
-				gltf.PrimitiveLines:         1,
-				gltf.PrimitiveLineLoop:      2,
-				gltf.PrimitiveLineStrip:     3,
-				gltf.PrimitiveTriangles:     4,
-				gltf.PrimitiveTriangleStrip: 5,
-				gltf.PrimitiveTriangleFan:   6,
-			}[primitive.Mode]
-
-			if primitive.Mode == gltf.PrimitiveLineLoop {
+			mode, ok := gxPrimitive[primitive.Mode]
+			if !ok {
 				return nil, fmt.Errorf(`unsupported primitive mode: line loop`)
 			}
 
+			bounds, err := primitiveBounds(model.Asset, primitive)
+			if err != nil {
+				return nil, err
+			}
+
+			dlOffset := UINT32_MAX
+			dl, desc, err := bakeDisplayList(model.Asset, primitive, colors)
+			if err != nil {
+				return nil, fmt.Errorf(`failed to bake display list (%w)`, err)
+			}
+			if dl != nil {
+				dlOffset = uint32(len(displayLists)) // each list is padded to 32B, so the next stays aligned
+				displayLists = append(displayLists, dl...)
+			} else {
+				*pak.Scratch += uint32(recordedDisplayListSize(model.Asset, primitive, colors))
+			}
+
 			primitives = append(primitives, BinMeshPrimitive{
-				AttrPos:      attributes["POSITION"],
-				AttrNormal:   attributes["NORMAL"],
-				AttrTangent:  attributes["TANGENT"],
-				AttrSt0:      attributes["TEXCOORD_0"],
-				AttrSt1:      attributes["TEXCOORD_1"],
-				AttrVc0:      attributes["COLOR_0"],
-				AttrJoints0:  attributes["JOINTS_0"],
-				AttrWeights0: attributes["WEIGHTS_0"],
-				Indices:      indices,
-				Material:     material,
-				Mode:         mode,
+				AttrPos:         attributes["POSITION"],
+				AttrNormal:      attributes["NORMAL"],
+				AttrTangent:     attributes["TANGENT"],
+				AttrSt0:         attributes["TEXCOORD_0"],
+				AttrSt1:         attributes["TEXCOORD_1"],
+				AttrVc0:         attributes["COLOR_0"],
+				AttrJoints0:     attributes["JOINTS_0"],
+				AttrWeights0:    attributes["WEIGHTS_0"],
+				Indices:         indices,
+				Material:        material,
+				Mode:            uint32(mode),
+				DisplayList:     dlOffset,
+				DisplayListSize: uint32(len(dl)),
+				VtxDesc:         desc,
+				BoundsMin:       bounds.Min,
+				BoundsMax:       bounds.Max,
 			})
 		}
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
+	*pak.Buffer, err = AlignPad(*pak.Buffer, 32)
 	if err != nil {
 		return nil, err
 	}
-	model.Directory.PrimitiveTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.PrimitiveTableCount = uint32(len(primitives))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, primitives)
-
-	return
-}
-
-func toRGB5A3(im image.Image) (out []uint16) {
-	const TILE_SIZE int = 4
-	out = []uint16{}
-
-	numTilesX := im.Bounds().Dx() / TILE_SIZE
-	if im.Bounds().Dx()%TILE_SIZE != 0 {
-		numTilesX++
-	}
-	numTilesY := im.Bounds().Dy() / TILE_SIZE
-	if im.Bounds().Dy()%TILE_SIZE != 0 {
-		numTilesY++
-	}
-	for tileY := range numTilesX {
-		for tileX := range numTilesY {
-			for texelY := range TILE_SIZE {
-				for texelX := range TILE_SIZE {
-					var texel uint16 = 0
-					srcX := TILE_SIZE*tileX + texelX
-					srcY := TILE_SIZE*tileY + texelY
-					r, g, b, a := im.At(srcX, srcY).RGBA()
-					/* squash from 0-65535 to 0-255 */
-					r /= 256
-					g /= 256
-					b /= 256
-					a /= 256
-
-					/* squash from 0-255 to 0-(bit depth) */
-					r /= 16
-					g /= 16
-					b /= 16
-					a /= 32
-
-					a <<= 12
-					r <<= 8
-					g <<= 4
-					texel = uint16(a | r | g | b)
-					out = append(out, texel)
-				}
-			}
-		}
-	}
+	model.Header.DisplayLists = uint32(len(*pak.Buffer))
+	model.Header.DisplayListsSize = uint32(len(displayLists))
+	*pak.Buffer = append(*pak.Buffer, displayLists...)
 
+	model.Tables.Primitives = primitives
 	return
 }
 
 func packMaterials(model Model, pak Pak) (err error) {
 	var materials []BinMaterial = []BinMaterial{}
 
-	wrapMode := map[gltf.WrappingMode]uint8{
-		gltf.WrapClampToEdge:    0,
-		gltf.WrapMirroredRepeat: 1,
-		gltf.WrapRepeat:         2,
+	wrapMode := map[gltf.WrappingMode]uint32{
+		gltf.WrapClampToEdge:    GX_CLAMP,
+		gltf.WrapMirroredRepeat: GX_MIRROR,
+		gltf.WrapRepeat:         GX_REPEAT,
+	}
+
+	// images are encoded once and stored once, however many materials use them.
+	// the runtime shares one buffer between those materials, so the scratch an
+	// image is decompressed into is counted once, by appendBlob
+	sources := []int{}
+	for _, material := range model.Asset.Materials {
+		texture := model.Asset.Textures[material.PBRMetallicRoughness.BaseColorTexture.Index]
+		if !slices.Contains(sources, *texture.Source) {
+			sources = append(sources, *texture.Source)
+		}
 	}
+	textures, err := encodeImages(model.Asset, sources, pak.Textures)
+	if err != nil {
+		return err
+	}
+	type textureBlob struct {
+		Offset         uint32
+		Length         uint32
+		CompressedSize uint32
+	}
+	blobs := map[int]textureBlob{}
+
 	for _, material := range model.Asset.Materials {
 		texture := model.Asset.Textures[material.PBRMetallicRoughness.BaseColorTexture.Index] // TODO: Handle nil
 
-		var wrapS, wrapT uint8
+		var wrapS, wrapT uint32
 		sampler := texture.Sampler
 		if sampler != nil {
 			wrapS = wrapMode[model.Asset.Samplers[*sampler].WrapS]
@@ -418,66 +511,49 @@ func packMaterials(model Model, pak Pak) (err error) {
 
 		name := uint32(len(*pak.StringTable))
 		*pak.StringTable = append(*pak.StringTable, ToCString(material.Name)...)
+		*pak.Scratch += GX_TEXOBJ_SIZE
 
-		*pak.Buffer, err = AlignPad(*pak.Buffer, 32)
-		if err != nil {
-			return err
-		}
-		texOffset := uint32(len(*pak.Buffer))
-		var source []byte
-		if model.Asset.Images[*texture.Source].BufferView == nil {
-			source, err = model.Asset.Images[*texture.Source].MarshalData()
+		tex := textures[slices.Index(sources, *texture.Source)]
+		blob, ok := blobs[*texture.Source]
+		if !ok {
+			blob.Length = uint32(len(tex.Data))
+			blob.Offset, blob.CompressedSize, err = appendBlob(pak, 32, tex.Data)
 			if err != nil {
-				return fmt.Errorf(`could not unmarshal texture source image (%w)`, err)
+				return err
 			}
-		} else {
-			bv := model.Asset.BufferViews[*model.Asset.Images[*texture.Source].BufferView]
-			source = model.Asset.Buffers[bv.Buffer].Data[bv.ByteOffset : bv.ByteOffset+bv.ByteLength]
-		}
-		im, _, err := image.Decode(bytes.NewBuffer(source))
-		if err != nil {
-			return fmt.Errorf(`could not decode image (%w)`, err)
+			blobs[*texture.Source] = blob
 		}
-		texBytes := toRGB5A3(im)
-		texLength := uint32(PackedSize(texBytes))
-		*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, texBytes)
 
-		width := uint16(im.Bounds().Dx())
-		height := uint16(im.Bounds().Dy())
-		if width > 1024 {
+		width := uint16(tex.Width)
+		height := uint16(tex.Height)
+		if tex.Width > 1024 {
 			return fmt.Errorf(`texture width exceeded 1024px`)
 		}
-		if height > 1024 {
+		if tex.Height > 1024 {
 			return fmt.Errorf(`texture height exceeded 1024px`)
 		}
-		if (wrapS == 1 || wrapS == 2) && width&(width-1) != 0 {
+		if wrapS != GX_CLAMP && width&(width-1) != 0 {
 			return fmt.Errorf(`texture width must be power of 2 with mirror or repeat wrapS`)
 		}
-		if (wrapS == 1 || wrapS == 2) && height&(height-1) != 0 {
+		if wrapT != GX_CLAMP && height&(height-1) != 0 {
 			return fmt.Errorf(`texture height must be power of 2 with mirror or repeat wrapT`)
 		}
 
 		materials = append(materials, BinMaterial{
-			Name:                   name,
-			BaseColorTextureOffset: texOffset,
-			BaseColorTextureLength: texLength,
-			Width:                  uint16(im.Bounds().Dx()),
-			Height:                 uint16(im.Bounds().Dy()),
-			TexCoord:               uint8(material.PBRMetallicRoughness.BaseColorTexture.TexCoord),
-			Format:                 uint8(8), // RGB5A3. TODO: support different formats
-			WrapS:                  wrapS,
-			WrapT:                  wrapT,
+			Name:           name,
+			Image:          blob.Offset,
+			ImageSize:      blob.Length,
+			CompressedSize: blob.CompressedSize,
+			Width:          width,
+			Height:         height,
+			TexCoord:       uint8(material.PBRMetallicRoughness.BaseColorTexture.TexCoord),
+			Format:         tex.Format,
+			WrapS:          wrapS,
+			WrapT:          wrapT,
 		})
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-	if err != nil {
-		return err
-	}
-	model.Directory.MaterialTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.MaterialTableCount = uint32(len(materials))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, materials)
-
+	model.Tables.Materials = materials
 	return
 }
 
@@ -505,11 +581,324 @@ func getAccessorContents(doc *gltf.Document, acr *gltf.Accessor) (contents any,
 	return
 }
 
+// largest error allowed when converting an attribute to fixed point, in the
+// attribute's own units. 0 leaves the attribute as it is, except for colors,
+// which are always converted to 8 bits per channel and use a smaller format
+// when one is within Color of that (channels range from 0 to 1)
+type Quantization struct {
+	Position float64
+	Normal   float64
+	TexCoord float64
+	Color    float64
+}
+
+type quantizeTarget struct {
+	Tolerance float64
+	Normal    bool
+}
+
+// the kind of attribute each vertex attribute accessor is used as, "" if it's
+// used as different ones
+func attributeKinds(doc *gltf.Document) map[int]string {
+	kinds := map[int]string{}
+	for _, mesh := range doc.Meshes {
+		for _, primitive := range mesh.Primitives {
+			for name, idx := range primitive.Attributes {
+				kind := name
+				if name == "TEXCOORD_0" || name == "TEXCOORD_1" {
+					kind = "TEXCOORD"
+				}
+				if strings.HasPrefix(name, "COLOR_") {
+					kind = "COLOR"
+				}
+				if prev, ok := kinds[idx]; ok && prev != kind {
+					kind = "" // used as different attributes, left as it is
+				}
+				kinds[idx] = kind
+			}
+		}
+	}
+	return kinds
+}
+
+// accessors used only as one kind of quantizable attribute
+func quantizableAccessors(doc *gltf.Document, q Quantization) map[int]quantizeTarget {
+	kinds := attributeKinds(doc)
+	targets := map[int]quantizeTarget{}
+	for idx, kind := range kinds {
+		var tolerance float64
+		switch kind {
+		case "POSITION":
+			tolerance = q.Position
+		case "NORMAL":
+			tolerance = q.Normal
+		case "TEXCOORD":
+			tolerance = q.TexCoord
+		}
+		if tolerance > 0 && doc.Accessors[idx].ComponentType == gltf.ComponentFloat {
+			targets[idx] = quantizeTarget{Tolerance: tolerance, Normal: kind == "NORMAL"}
+		}
+	}
+	return targets
+}
+
+// accessors used only as vertex colors, which are packed in a GX color format
+func colorAccessors(doc *gltf.Document) map[int]bool {
+	colors := map[int]bool{}
+	for idx, kind := range attributeKinds(doc) {
+		acr := doc.Accessors[idx]
+		if kind == "COLOR" && (acr.Type == gltf.AccessorVec3 || acr.Type == gltf.AccessorVec4) {
+			colors[idx] = true
+		}
+	}
+	return colors
+}
+
+// bits per channel of the GX color formats, red first. alpha is absent from
+// the RGB formats
+var gxColorBits = map[uint8][]uint{
+	GX_RGB565: {5, 6, 5},
+	GX_RGB8:   {8, 8, 8},
+	GX_RGBA4:  {4, 4, 4, 4},
+	GX_RGBA6:  {6, 6, 6, 6},
+	GX_RGBA8:  {8, 8, 8, 8},
+}
+
+// the 8 bit value GX expands a `bits` wide channel to, by repeating its bits
+func gxExpandChannel(q uint32, bits uint) uint32 {
+	return q<<(8-bits) | q>>(2*bits-8)
+}
+
+/*
+converts vertex colors (float, normalized u8 or u16, RGB or RGBA) to the
+smallest GX color format that keeps every channel within `tolerance` of its
+8 bit value, so GX can fetch them as they are rather than the CPU converting
+them for every vertex
+*/
+func packColors(contents any, tolerance float64) (out []byte, format uint8, alpha bool) {
+	v := reflect.ValueOf(contents)
+	alpha = v.Type().Elem().Len() == 4
+	channels := make([][]uint32, v.Len()) // 8 bit
+	for i := range v.Len() {
+		for c := range v.Index(i).Len() {
+			var x float64
+			switch component := v.Index(i).Index(c); component.Kind() {
+			case reflect.Float32, reflect.Float64:
+				x = component.Float()
+			case reflect.Uint8:
+				x = float64(component.Uint()) / math.MaxUint8
+			default:
+				x = float64(component.Uint()) / math.MaxUint16
+			}
+			channels[i] = append(channels[i], uint32(math.Round(math.Min(math.Max(x, 0), 1)*math.MaxUint8)))
+		}
+	}
+
+	candidates := []uint8{GX_RGB565, GX_RGB8}
+	if alpha {
+		candidates = []uint8{GX_RGBA4, GX_RGBA6, GX_RGBA8}
+	}
+	for _, format = range candidates {
+		bits := gxColorBits[format]
+		fits := true
+		packed := make([]uint32, len(channels))
+		for i, color := range channels {
+			for c, value := range color {
+				q := uint32(math.Round(float64(value) * float64(uint32(1)<<bits[c]-1) / math.MaxUint8))
+				if math.Abs(float64(gxExpandChannel(q, bits[c]))-float64(value)) > tolerance*math.MaxUint8 {
+					fits = false
+				}
+				packed[i] = packed[i]<<bits[c] | q
+			}
+		}
+		if !fits && bits[0] != 8 {
+			continue
+		}
+
+		size := 0
+		for _, b := range bits {
+			size += int(b)
+		}
+		size /= 8
+		for _, p := range packed {
+			for b := size - 1; b >= 0; b-- {
+				out = append(out, uint8(p>>(8*b)))
+			}
+		}
+		return out, format, alpha
+	}
+	return
+}
+
+/*
+converts float vector components to GX fixed point, choosing the smallest
+type and then the most fractional bits that keep every component within
+`tolerance`. normals always use 6 (S8) or 14 (S16) fractional bits, as GX
+ignores the vertex format's shift for them. returns nil if no fixed point
+format is accurate enough
+*/
+func quantizeAccessor(contents any, tolerance float64, normal bool) (out any, componentType uint32, frac uint8) {
+	values := []float64{}
+	v := reflect.ValueOf(contents)
+	for i := range v.Len() {
+		for j := range v.Index(i).Len() {
+			values = append(values, v.Index(i).Index(j).Float())
+		}
+	}
+	maxAbs := 0.0
+	for _, value := range values {
+		maxAbs = max(maxAbs, math.Abs(value))
+	}
+
+	candidates := []struct {
+		componentType uint32
+		limit         float64
+		normalFrac    uint8
+	}{
+		{GX_S8, math.MaxInt8, 6},
+		{GX_S16, math.MaxInt16, 14},
+	}
+	for _, c := range candidates {
+		frac := c.normalFrac
+		if !normal {
+			frac = 0
+			for frac < 31 && maxAbs*math.Exp2(float64(frac+1)) <= c.limit {
+				frac++
+			}
+		}
+		scale := math.Exp2(float64(frac))
+		if maxAbs*scale > c.limit {
+			continue
+		}
+
+		fits := true
+		for _, value := range values {
+			if math.Abs(math.Round(value*scale)/scale-value) > tolerance {
+				fits = false
+				break
+			}
+		}
+		if !fits {
+			continue
+		}
+
+		if c.componentType == GX_S8 {
+			quantized := make([]int8, len(values))
+			for i, value := range values {
+				quantized[i] = int8(math.Round(value * scale))
+			}
+			return quantized, c.componentType, frac
+		}
+		quantized := make([]int16, len(values))
+		for i, value := range values {
+			quantized[i] = int16(math.Round(value * scale))
+		}
+		return quantized, c.componentType, frac
+	}
+	return nil, 0, 0
+}
+
+// an accessor's table entry along with its contents, which are only placed in
+// the PAK once every accessor is known, as several may share one stream
+type packedAccessor struct {
+	BinAccessor
+	Contents      []byte // nil if interleaved into another accessor's stream
+	ComponentSize uint32
+}
+
+/*
+interleaves the attributes GX fetches for each primitive (position, normal,
+color and texture coordinate) into one stream owned by its position accessor,
+so that a vertex is fetched from neighbouring bytes, read with one request,
+instead of from up to four arrays. accessors also used elsewhere are left as
+they are, as an accessor can only be part of one stream
+*/
+func interleaveAccessors(doc *gltf.Document, packed []packedAccessor) {
+	uses := map[int]int{}
+	for _, mesh := range doc.Meshes {
+		for _, primitive := range mesh.Primitives {
+			for _, idx := range primitive.Attributes {
+				uses[idx]++
+			}
+			if primitive.Indices != nil {
+				uses[*primitive.Indices]++
+			}
+		}
+	}
+
+	for _, mesh := range doc.Meshes {
+		for _, primitive := range mesh.Primitives {
+			position, ok := primitive.Attributes["POSITION"]
+			if !ok || uses[position] != 1 {
+				continue
+			}
+			members := []int{position}
+			add := func(name string) {
+				idx, ok := primitive.Attributes[name]
+				if ok && uses[idx] == 1 && packed[idx].Count == packed[position].Count {
+					members = append(members, idx)
+				}
+			}
+			add("NORMAL")
+			// colors left as floats or u16 are converted by the CPU, not fetched by GX
+			if idx, ok := primitive.Attributes["COLOR_0"]; ok &&
+				(packed[idx].ComponentType == GX_U8 || packed[idx].ComponentType == COMPONENT_COLOR) {
+				add("COLOR_0")
+			}
+			// the runtime only draws one set of texture coordinates
+			if _, ok := primitive.Attributes["TEXCOORD_0"]; ok {
+				add("TEXCOORD_0")
+			} else {
+				add("TEXCOORD_1")
+			}
+			if len(members) < 2 {
+				continue
+			}
+
+			// each attribute is aligned to its component size within the record
+			offsets := make([]uint32, len(members))
+			var stride, alignment uint32 = 0, 1
+			for i, idx := range members {
+				size := packed[idx].ComponentSize
+				stride = (stride + size - 1) / size * size
+				offsets[i] = stride
+				stride += packed[idx].Stride
+				alignment = max(alignment, size)
+			}
+			stride = (stride + alignment - 1) / alignment * alignment
+			if stride > math.MaxUint8 { // GX array strides are 8 bits
+				continue
+			}
+
+			count := packed[position].Count
+			stream := make([]byte, stride*count)
+			for i, idx := range members {
+				size := packed[idx].Stride
+				for v := range count {
+					copy(stream[v*stride+offsets[i]:], packed[idx].Contents[v*size:(v+1)*size])
+				}
+			}
+			for i, idx := range members {
+				packed[idx].Stride = stride
+				if i == 0 {
+					packed[idx].Contents = stream
+				} else {
+					packed[idx].Contents = nil
+					packed[idx].InterleavedWith = uint32(position)
+					packed[idx].Buffer = offsets[i]
+				}
+			}
+		}
+	}
+}
+
 func packAccessors(model Model, pak Pak) (err error) {
-	var accessors []BinAccessor = []BinAccessor{}
+	packed := []packedAccessor{}
+	quantizable := quantizableAccessors(model.Asset, pak.Quantize)
+	colors := colorAccessors(model.Asset)
 
-	for _, accessor := range model.Asset.Accessors {
-		var elementType uint8
+	for accessorIdx, accessor := range model.Asset.Accessors {
+		var elementType uint32
 		switch accessor.Type {
 		case gltf.AccessorScalar:
 			elementType = 0
@@ -530,46 +919,159 @@ func packAccessors(model Model, pak Pak) (err error) {
 		name := uint32(len(*pak.StringTable))
 		*pak.StringTable = append(*pak.StringTable, ToCString(accessor.Name)...)
 
-		*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-		if err != nil {
-			return err
-		}
-		bufferOffset := uint32(len(*pak.Buffer))
 		contents, err := getAccessorContents(model.Asset, accessor)
 		if err != nil {
 			return err
 		}
-		*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, contents)
 
-		accessors = append(accessors, BinAccessor{
-			Name:          name,
-			BufferOffset:  bufferOffset,
-			Count:         uint32(accessor.Count),
-			ComponentType: uint8(accessor.ComponentType),
-			ElementType:   elementType,
+		componentType := map[gltf.ComponentType]uint32{
+			gltf.ComponentFloat:  GX_F32,
+			gltf.ComponentByte:   GX_S8,
+			gltf.ComponentUbyte:  GX_U8,
+			gltf.ComponentShort:  GX_S16,
+			gltf.ComponentUshort: GX_U16,
+			gltf.ComponentUint:   COMPONENT_U32,
+		}[accessor.ComponentType]
+		stride := uint32(accessor.ComponentType.ByteSize() * accessor.Type.Components())
+		componentSize := uint32(accessor.ComponentType.ByteSize())
+		var frac uint8 = 0
+		var colorFormat uint8 = 0
+		if target, ok := quantizable[accessorIdx]; ok {
+			quantized, quantizedType, quantizedFrac := quantizeAccessor(contents, target.Tolerance, target.Normal)
+			if quantized != nil {
+				contents = quantized
+				componentType = quantizedType
+				frac = quantizedFrac
+				stride = uint32(PackedSize(quantized) / accessor.Count)
+				componentSize = uint32(PackedSize(quantized) / accessor.Count / accessor.Type.Components())
+			}
+		}
+		if colors[accessorIdx] {
+			packedColors, format, alpha := packColors(contents, pak.Quantize.Color)
+			contents = packedColors
+			componentType = COMPONENT_COLOR
+			colorFormat = format
+			elementType = 2 // VEC3 for the RGB formats, which have no alpha
+			if alpha {
+				elementType = 3
+			}
+			stride = uint32(len(packedColors) / accessor.Count)
+			componentSize = 1
+			if stride == 2 { // 16 bit formats
+				componentSize = 2
+			}
+		}
+
+		packed = append(packed, packedAccessor{
+			BinAccessor: BinAccessor{
+				Name:            name,
+				InterleavedWith: UINT32_MAX,
+				Count:           uint32(accessor.Count),
+				Stride:          stride,
+				ComponentType:   componentType,
+				ElementType:     elementType,
+				Frac:            frac,
+				ColorFormat:     colorFormat,
+			},
+			Contents:      AppendOrPanic(nil, binary.BigEndian, contents),
+			ComponentSize: componentSize,
 		})
 	}
 
-	*pak.Buffer, err = AlignPad(*pak.Buffer, 4)
-	if err != nil {
-		return err
+	if pak.Interleave {
+		interleaveAccessors(model.Asset, packed)
 	}
-	model.Directory.AccessorTableOffset = uint32(len(*pak.Buffer))
-	model.Directory.AccessorTableCount = uint32(len(accessors))
-	*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, accessors)
 
+	accessors := make([]BinAccessor, len(packed))
+	for i, p := range packed {
+		accessors[i] = p.BinAccessor
+		if p.Contents == nil {
+			continue
+		}
+		accessors[i].Buffer, accessors[i].CompressedSize, err = appendBlob(pak, 32, p.Contents) // may be used in place as a GX array
+		if err != nil {
+			return err
+		}
+	}
+
+	model.Tables.Accessors = accessors
 	return
 }
 
+// appends `table` to the model block `block`, aligned to `alignment`, and
+// returns its offset from the start of the block
+func appendTable(block *[]byte, alignment uint, table any) (offset uint32, err error) {
+	*block, err = AlignPad(*block, alignment)
+	if err != nil {
+		return 0, err
+	}
+	offset = uint32(len(*block))
+	*block = AppendOrPanic(*block, binary.BigEndian, table)
+	return
+}
+
+// writes the model's header and all of its tables as one contiguous block,
+// which the runtime reads with a single request and fixes up in place
+func packModel(model Model, pak Pak) (offset uint32, length uint32, err error) {
+	header := model.Header
+	header.NumIdxs = uint32(len(*model.IndexTable))
+	header.NumNodes = uint32(len(model.Tables.Nodes))
+	header.NumMeshes = uint32(len(model.Tables.Meshes))
+	header.NumMaterials = uint32(len(model.Tables.Materials))
+	header.NumPrimitives = uint32(len(model.Tables.Primitives))
+	header.NumAccessors = uint32(len(model.Tables.Accessors))
+	header.NumScenes = uint32(len(model.Tables.Scenes))
+	header.NumBVHNodes = uint32(len(model.Tables.BVHNodes))
+	header.NumBVHItems = uint32(len(model.Tables.BVHItems))
+
+	block := AppendOrPanic(nil, binary.BigEndian, header) // placeholder offsets, overwritten below
+	tables := []struct {
+		offset    *uint32
+		alignment uint
+		data      any
+	}{
+		{&header.Idxs, 4, *model.IndexTable},
+		{&header.Nodes, 4, model.Tables.Nodes},
+		{&header.Meshes, 4, model.Tables.Meshes},
+		{&header.Materials, 4, model.Tables.Materials},
+		{&header.Primitives, 4, model.Tables.Primitives},
+		{&header.Accessors, 4, model.Tables.Accessors},
+		{&header.Scenes, 4, model.Tables.Scenes},
+		{&header.BVHNodes, 32, model.Tables.BVHNodes}, // one node per cache line
+		{&header.BVHItems, 4, model.Tables.BVHItems},
+	}
+	for _, table := range tables {
+		*table.offset, err = appendTable(&block, table.alignment, table.data)
+		if err != nil {
+			return 0, 0, err
+		}
+	}
+	AppendOrPanic(block[:0], binary.BigEndian, header)
+
+	*pak.Buffer, err = AlignPad(*pak.Buffer, 32)
+	if err != nil {
+		return 0, 0, err
+	}
+	offset = uint32(len(*pak.Buffer))
+	*pak.Buffer = append(*pak.Buffer, block...)
+	return offset, uint32(len(block)), nil
+}
+
 func PackLevel(level Level, root string) (buf []byte, err error) {
 	pak := Pak{
 		Buffer:      &buf,
 		Directory:   &[]BinDirectoryEntry{},
 		StringTable: &[]byte{},
+		Compress:    level.Compress,
+		Quantize:    level.Quantize,
+		Interleave:  level.Interleave,
+		Textures:    level.Textures,
+		Scratch:     new(uint32),
 	}
 
 	header := BinPakHeader{
-		Signature:         1328676866,
+		Signature:         [2]uint8{'O', '2'},
+		Version:           PAK_VERSION,
 		StringTableLength: 0,
 		StringTableOffset: 0,
 		DirectoryCount:    0,
@@ -583,11 +1085,22 @@ func PackLevel(level Level, root string) (buf []byte, err error) {
 		if err != nil {
 			return nil, fmt.Errorf(`failed to open or load glTF file "%s" (%w)`, path, err)
 		}
+		err = splitPrimitives(asset)
+		if err != nil {
+			return nil, fmt.Errorf(`failed to split primitives of "%s" (%w)`, path, err)
+		}
+		if level.Optimize {
+			err = optimizeMeshes(asset, level.Strips)
+			if err != nil {
+				return nil, fmt.Errorf(`failed to optimize meshes of "%s" (%w)`, path, err)
+			}
+		}
 
 		model := Model{
 			Asset:      asset,
-			Directory:  new(BinModelDirectory),
+			Header:     new(BinModel),
 			IndexTable: &[]uint32{},
+			Tables:     new(ModelTables),
 		}
 
 		err = packAccessors(model, pak)
@@ -606,6 +1119,10 @@ func PackLevel(level Level, root string) (buf []byte, err error) {
 		if err != nil {
 			return nil, fmt.Errorf(`failed to pack meshes (%w)`, err)
 		}
+		err = packBVH(model, idxs)
+		if err != nil {
+			return nil, fmt.Errorf(`failed to pack bounding volume hierarchy (%w)`, err)
+		}
 		err = packNodes(model, pak)
 		if err != nil {
 			return nil, fmt.Errorf(`failed to pack nodes (%w)`, err)
@@ -615,20 +1132,17 @@ func PackLevel(level Level, root string) (buf []byte, err error) {
 			return nil, fmt.Errorf(`failed to pack scenes (%w)`, err)
 		}
 
-		buf, err = AlignPad(*pak.Buffer, 4)
+		offset, length, err := packModel(model, pak)
 		if err != nil {
-			return nil, err
+			return nil, fmt.Errorf(`failed to pack model tables (%w)`, err)
 		}
-		model.Directory.IndexTableCount = uint32(len(*model.IndexTable))
-		model.Directory.IndexTableOffset = uint32(len(buf))
-		buf = AppendOrPanic(buf, binary.BigEndian, *model.IndexTable)
 
 		entry := BinDirectoryEntry{
 			Name:   uint32(len(*pak.StringTable)),
-			Offset: uint32(len(buf)),
+			Offset: offset,
 			Type:   0,
+			Length: length,
 		}
-		*pak.Buffer = AppendOrPanic(*pak.Buffer, binary.BigEndian, model.Directory)
 		*pak.StringTable = append(*pak.StringTable, ToCString(name)...)
 		*pak.Directory = append(*pak.Directory, entry)
 	}
@@ -645,6 +1159,7 @@ func PackLevel(level Level, root string) (buf []byte, err error) {
 	if err != nil {
 		return nil, err
 	}
+	header.ScratchSize = *pak.Scratch
 	header.DirectoryCount = uint32(len(*pak.Directory))
 	header.DirectoryOffset = uint32(len(buf))
 	buf = AppendOrPanic(buf, binary.BigEndian, *pak.Directory)
@@ -0,0 +1,98 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"bytes"
+	"image"
+	"image/png"
+	"testing"
+
+	"github.com/qmuntal/gltf"
+)
+
+// a document with one flat 64x64 PNG, embedded in a buffer, used by
+// `numMaterials` materials
+func sharedImageDocument(t *testing.T, numMaterials int) *gltf.Document {
+	im := image.NewNRGBA(image.Rect(0, 0, 64, 64))
+	for i := 0; i < len(im.Pix); i += 4 {
+		copy(im.Pix[i:], []byte{0x40, 0x80, 0xC0, 0xFF})
+	}
+	var encoded bytes.Buffer
+	if err := png.Encode(&encoded, im); err != nil {
+		t.Fatal(err)
+	}
+
+	source, bufferView := 0, 0
+	doc := &gltf.Document{
+		Buffers:     []*gltf.Buffer{{ByteLength: encoded.Len(), Data: encoded.Bytes()}},
+		BufferViews: []*gltf.BufferView{{Buffer: 0, ByteLength: encoded.Len()}},
+		Images:      []*gltf.Image{{Name: "shared", MimeType: "image/png", BufferView: &bufferView}},
+		Textures:    []*gltf.Texture{{Source: &source}},
+	}
+	for i := 0; i < numMaterials; i++ {
+		doc.Materials = append(doc.Materials, &gltf.Material{
+			PBRMetallicRoughness: &gltf.PBRMetallicRoughness{BaseColorTexture: &gltf.TextureInfo{Index: 0}},
+		})
+	}
+	return doc
+}
+
+func TestPackMaterialsSharesImages(t *testing.T) {
+	model := Model{
+		Asset:      sharedImageDocument(t, 2),
+		Header:     new(BinModel),
+		IndexTable: &[]uint32{},
+		Tables:     new(ModelTables),
+	}
+	buf := []byte{}
+	pak := Pak{
+		Buffer:      &buf,
+		Directory:   &[]BinDirectoryEntry{},
+		StringTable: &[]byte{},
+		Compress:    true,
+		Textures:    TextureFormats{Default: "RGBA8"},
+		Scratch:     new(uint32),
+	}
+	if err := packMaterials(model, pak); err != nil {
+		t.Fatal(err)
+	}
+
+	materials := model.Tables.Materials
+	if len(materials) != 2 {
+		t.Fatalf("packed %d materials, want 2", len(materials))
+	}
+	a, b := materials[0], materials[1]
+	if a.Image != b.Image || a.ImageSize != b.ImageSize || a.CompressedSize != b.CompressedSize {
+		t.Errorf("materials point at different copies of the image: %+v, %+v", a, b)
+	}
+	if a.CompressedSize == 0 {
+		t.Fatalf("a flat image wasn't compressed")
+	}
+	if len(buf) > int(a.Image)+roundUp32(int(a.CompressedSize)) {
+		t.Errorf("stored %d bytes for one %d byte image", len(buf), a.CompressedSize)
+	}
+
+	// the runtime decompresses the shared image into one buffer, and sets up a
+	// texture object for each material
+	want := uint32(roundUp32(int(a.ImageSize))) + 2*GX_TEXOBJ_SIZE
+	if *pak.Scratch != want {
+		t.Errorf("ScratchSize is %d, want %d", *pak.Scratch, want)
+	}
+}
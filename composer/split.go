@@ -0,0 +1,236 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"fmt"
+	"reflect"
+	"slices"
+
+	"github.com/qmuntal/gltf"
+	"github.com/qmuntal/gltf/modeler"
+)
+
+const GX_MAX_BATCH_VERTICES int = 0xFFFF // an index of all ones makes GX skip the vertex
+const GX_MAX_BATCH_INDICES int = 0xFFFF  // GX_Begin vertex count is 16-bit
+
+// converts strips and fans to lists, which can be cut anywhere between two
+// elements. returns the list's mode and its number of indices per element
+func listIndices(mode gltf.PrimitiveMode, indices []uint32) (list []uint32, listMode gltf.PrimitiveMode, size int) {
+	switch mode {
+	case gltf.PrimitivePoints:
+		return indices, mode, 1
+	case gltf.PrimitiveLines:
+		return indices, mode, 2
+	case gltf.PrimitiveLineStrip:
+		for i := 0; i+1 < len(indices); i++ {
+			list = append(list, indices[i], indices[i+1])
+		}
+		return list, gltf.PrimitiveLines, 2
+	case gltf.PrimitiveTriangleStrip:
+		for i := 0; i+2 < len(indices); i++ {
+			if i%2 == 0 {
+				list = append(list, indices[i], indices[i+1], indices[i+2])
+			} else { // odd triangles are wound the other way
+				list = append(list, indices[i+1], indices[i], indices[i+2])
+			}
+		}
+		return list, gltf.PrimitiveTriangles, 3
+	case gltf.PrimitiveTriangleFan:
+		for i := 1; i+1 < len(indices); i++ {
+			list = append(list, indices[0], indices[i], indices[i+1])
+		}
+		return list, gltf.PrimitiveTriangles, 3
+	default:
+		return indices, gltf.PrimitiveTriangles, 3
+	}
+}
+
+/*
+cuts `primitive` into batches GX can draw, each addressing at most
+GX_MAX_BATCH_VERTICES vertices with 16-bit indices. every batch has its own
+copy of the vertices it uses, renumbered from 0. accessors used by nothing
+else are reused for the first batch, so the originals aren't packed as well
+*/
+func splitPrimitive(doc *gltf.Document, primitive *gltf.Primitive, uses map[int]int) (batches []*gltf.Primitive, err error) {
+	if len(primitive.Targets) > 0 {
+		return nil, fmt.Errorf(`primitives with morph targets must have fewer than %d vertices`, GX_MAX_BATCH_VERTICES)
+	}
+	var indices []uint32
+	if primitive.Indices != nil {
+		indices, err = modeler.ReadIndices(doc, doc.Accessors[*primitive.Indices], nil)
+		if err != nil {
+			return nil, fmt.Errorf(`failed to read indices (%w)`, err)
+		}
+	} else {
+		for v := range doc.Accessors[primitive.Attributes["POSITION"]].Count {
+			indices = append(indices, uint32(v))
+		}
+	}
+	list, mode, size := listIndices(primitive.Mode, indices)
+
+	attributes := map[string]reflect.Value{}
+	for name, idx := range primitive.Attributes {
+		contents, err := modeler.ReadAccessor(doc, doc.Accessors[idx], nil)
+		if err != nil {
+			return nil, fmt.Errorf(`failed to read accessor (%w)`, err)
+		}
+		attributes[name] = reflect.ValueOf(contents)
+	}
+
+	// writes a new accessor, or replaces `idx` if nothing else uses it and it hasn't been replaced yet
+	reused := map[int]bool{}
+	write := func(idx int, target gltf.Target, data any) int {
+		if uses[idx] == 1 && !reused[idx] {
+			reused[idx] = true
+			replaceAccessor(doc, idx, target, data)
+			doc.Accessors[idx].Min, doc.Accessors[idx].Max = nil, nil
+			return idx
+		}
+		return modeler.WriteAccessor(doc, target, data)
+	}
+
+	remap := map[uint32]uint16{}
+	vertices := []uint32{} // original index of each vertex of the batch
+	batchIndices := []uint16{}
+	flush := func() {
+		if len(batchIndices) == 0 {
+			return
+		}
+		batch := *primitive
+		batch.Mode = mode
+		batch.Attributes = gltf.Attributes{}
+		for name, contents := range attributes {
+			data := reflect.MakeSlice(contents.Type(), len(vertices), len(vertices))
+			for i, v := range vertices {
+				data.Index(i).Set(contents.Index(int(v)))
+			}
+			batch.Attributes[name] = write(primitive.Attributes[name], gltf.TargetArrayBuffer, data.Interface())
+		}
+		if primitive.Indices != nil {
+			idx := write(*primitive.Indices, gltf.TargetElementArrayBuffer, batchIndices)
+			batch.Indices = &idx
+		} else {
+			idx := modeler.WriteIndices(doc, batchIndices)
+			batch.Indices = &idx
+		}
+		batches = append(batches, &batch)
+		clear(remap)
+		vertices = []uint32{}
+		batchIndices = []uint16{}
+	}
+
+	for e := 0; e+size <= len(list); e += size {
+		element := list[e : e+size]
+		added := 0
+		for i, v := range element {
+			if _, ok := remap[v]; !ok && !slices.Contains(element[:i], v) {
+				added++
+			}
+		}
+		if len(vertices)+added > GX_MAX_BATCH_VERTICES || len(batchIndices)+size > GX_MAX_BATCH_INDICES {
+			flush()
+		}
+		for _, v := range element {
+			n, ok := remap[v]
+			if !ok {
+				n = uint16(len(vertices))
+				remap[v] = n
+				vertices = append(vertices, v)
+			}
+			batchIndices = append(batchIndices, n)
+		}
+	}
+	flush()
+	return
+}
+
+/*
+makes every primitive drawable with 16-bit indices, which is what the runtime
+reads. primitives that address or draw more vertices than GX can in one go
+are split into batches, and other index buffers are widened or narrowed to
+16 bits. draws are still as narrow as their vertex count allows, as display
+lists and the runtime pick GX_INDEX8 where it fits.
+*/
+func splitPrimitives(doc *gltf.Document) (err error) {
+	uses := map[int]int{}
+	primitives := []*gltf.Primitive{}
+	for _, mesh := range doc.Meshes {
+		for _, primitive := range mesh.Primitives {
+			if slices.Contains(primitives, primitive) {
+				continue
+			}
+			primitives = append(primitives, primitive)
+			for _, idx := range primitive.Attributes {
+				uses[idx]++
+			}
+			if primitive.Indices != nil {
+				uses[*primitive.Indices]++
+			}
+		}
+	}
+
+	batches := map[*gltf.Primitive][]*gltf.Primitive{}
+	widened := map[int]bool{}
+	for _, primitive := range primitives {
+		if primitive.Mode == gltf.PrimitiveLineLoop { // refused when packing
+			continue
+		}
+
+		if primitive.Indices == nil {
+			if pos, ok := primitive.Attributes["POSITION"]; ok && doc.Accessors[pos].Count > GX_MAX_BATCH_INDICES {
+				batches[primitive], err = splitPrimitive(doc, primitive, uses)
+			}
+		} else {
+			acr := doc.Accessors[*primitive.Indices]
+			var indices []uint32
+			indices, err = modeler.ReadIndices(doc, acr, nil)
+			if err != nil {
+				return fmt.Errorf(`failed to read indices (%w)`, err)
+			}
+			switch {
+			case len(indices) > GX_MAX_BATCH_INDICES || slices.Max(append(indices, 0)) >= uint32(GX_MAX_BATCH_VERTICES):
+				batches[primitive], err = splitPrimitive(doc, primitive, uses)
+			case acr.ComponentType != gltf.ComponentUshort && !widened[*primitive.Indices]:
+				out := make([]uint16, len(indices))
+				for i, v := range indices {
+					out[i] = uint16(v)
+				}
+				replaceAccessor(doc, *primitive.Indices, gltf.TargetElementArrayBuffer, out)
+				widened[*primitive.Indices] = true
+			}
+		}
+		if err != nil {
+			return err
+		}
+	}
+
+	for _, mesh := range doc.Meshes {
+		var out []*gltf.Primitive
+		for _, primitive := range mesh.Primitives {
+			if b, ok := batches[primitive]; ok {
+				out = append(out, b...)
+			} else {
+				out = append(out, primitive)
+			}
+		}
+		mesh.Primitives = out
+	}
+	return
+}
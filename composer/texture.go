@@ -0,0 +1,557 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"bytes"
+	"errors"
+	"fmt"
+	"image"
+	"image/draw"
+	_ "image/jpeg"
+	_ "image/png"
+	"math"
+	"runtime"
+	"sync"
+	"sync/atomic"
+
+	"github.com/qmuntal/gltf"
+)
+
+/* GX texture formats (GXTexFmt) */
+const (
+	GX_TF_I4     uint32 = 0
+	GX_TF_I8     uint32 = 1
+	GX_TF_IA4    uint32 = 2
+	GX_TF_IA8    uint32 = 3
+	GX_TF_RGB565 uint32 = 4
+	GX_TF_RGB5A3 uint32 = 5
+	GX_TF_RGBA8  uint32 = 6
+	GX_TF_CMPR   uint32 = 14
+)
+
+const GX_TEXOBJ_SIZE uint32 = 32 // sizeof(GXTexObj), which the runtime allocates for each material
+
+type texel = [4]uint8 // non-premultiplied r, g, b, a
+
+/*
+a GX texture format. texels are stored in tiles of TileWidth by TileHeight,
+left to right then top to bottom, with the image padded out to whole tiles.
+Encode writes the TileSize bytes of one tile from its texels, row by row
+*/
+type gxTextureFormat struct {
+	Format     uint32
+	TileWidth  int
+	TileHeight int
+	TileSize   int
+	Encode     func(dst []byte, texels []texel)
+}
+
+var gxTextureFormats = map[string]gxTextureFormat{
+	"I4":     {GX_TF_I4, 8, 8, 32, encodeI4},
+	"I8":     {GX_TF_I8, 8, 4, 32, encodeI8},
+	"IA4":    {GX_TF_IA4, 8, 4, 32, encodeIA4},
+	"IA8":    {GX_TF_IA8, 4, 4, 32, encodeIA8},
+	"RGB565": {GX_TF_RGB565, 4, 4, 32, encodeRGB565},
+	"RGB5A3": {GX_TF_RGB5A3, 4, 4, 32, encodeRGB5A3},
+	"RGBA8":  {GX_TF_RGBA8, 4, 4, 64, encodeRGBA8},
+	"CMPR":   {GX_TF_CMPR, 8, 8, 32, encodeCMPR},
+}
+
+// texture format overrides, by the names in gxTextureFormats. images not
+// listed use Default, or a format chosen from their contents if that's empty
+type TextureFormats struct {
+	Default string
+	Images  map[string]string // by glTF image name
+}
+
+// rounds an 8-bit channel to `bits` bits
+func quantizeChannel(v uint8, bits uint) uint16 {
+	top := 1<<bits - 1
+	return uint16((int(v)*top + 127) / 255)
+}
+
+// expands a channel of `bits` bits back to 8, the way GX does
+func expandChannel(v uint16, bits uint) uint8 {
+	v <<= 8 - bits
+	return uint8(v | v>>bits)
+}
+
+func intensity(t texel) uint8 {
+	return uint8((299*int(t[0]) + 587*int(t[1]) + 114*int(t[2]) + 500) / 1000)
+}
+
+func encodeI4(dst []byte, texels []texel) {
+	for i := 0; i < len(texels); i += 2 {
+		dst[i/2] = byte(quantizeChannel(intensity(texels[i]), 4)<<4 | quantizeChannel(intensity(texels[i+1]), 4))
+	}
+}
+
+func encodeI8(dst []byte, texels []texel) {
+	for i, t := range texels {
+		dst[i] = intensity(t)
+	}
+}
+
+func encodeIA4(dst []byte, texels []texel) {
+	for i, t := range texels {
+		dst[i] = byte(quantizeChannel(t[3], 4)<<4 | quantizeChannel(intensity(t), 4))
+	}
+}
+
+func encodeIA8(dst []byte, texels []texel) {
+	for i, t := range texels {
+		dst[i*2] = t[3]
+		dst[i*2+1] = intensity(t)
+	}
+}
+
+func rgb565(t texel) uint16 {
+	return quantizeChannel(t[0], 5)<<11 | quantizeChannel(t[1], 6)<<5 | quantizeChannel(t[2], 5)
+}
+
+func encodeRGB565(dst []byte, texels []texel) {
+	for i, t := range texels {
+		v := rgb565(t)
+		dst[i*2], dst[i*2+1] = byte(v>>8), byte(v)
+	}
+}
+
+// with the top bit set a texel is opaque RGB555, otherwise it's RGB444 with
+// 3 bits of alpha. texels too opaque for 3 bits of alpha to tell apart take
+// the extra color precision
+func encodeRGB5A3(dst []byte, texels []texel) {
+	for i, t := range texels {
+		var v uint16
+		if a := quantizeChannel(t[3], 3); a == 7 {
+			v = 0x8000 | quantizeChannel(t[0], 5)<<10 | quantizeChannel(t[1], 5)<<5 | quantizeChannel(t[2], 5)
+		} else {
+			v = a<<12 | quantizeChannel(t[0], 4)<<8 | quantizeChannel(t[1], 4)<<4 | quantizeChannel(t[2], 4)
+		}
+		dst[i*2], dst[i*2+1] = byte(v>>8), byte(v)
+	}
+}
+
+// the alpha and red of every texel of the tile, then its green and blue
+func encodeRGBA8(dst []byte, texels []texel) {
+	for i, t := range texels {
+		dst[i*2], dst[i*2+1] = t[3], t[0]
+		dst[32+i*2], dst[32+i*2+1] = t[1], t[2]
+	}
+}
+
+// a CMPR tile is 2x2 S3TC (DXT1) blocks of 4x4 texels
+func encodeCMPR(dst []byte, texels []texel) {
+	var block [16]texel
+	for b := range 4 {
+		bx, by := b%2*4, b/2*4
+		for y := range 4 {
+			copy(block[y*4:y*4+4], texels[(by+y)*8+bx:(by+y)*8+bx+4])
+		}
+		encodeCMPRBlock(dst[b*8:b*8+8], &block)
+	}
+}
+
+/*
+where each palette entry of a CMPR block lies between its two colors. GX
+blends the in-between entries 3/8 and 5/8 of the way rather than at the
+thirds of DXT1. a block whose first color is no greater than its second has
+3 colors instead, the last entry being transparent
+*/
+var cmprWeights4 = []float64{0, 1, 3.0 / 8, 5.0 / 8}
+var cmprWeights3 = []float64{0, 1, 1.0 / 2}
+
+const CMPR_REFINE_ITERATIONS int = 4
+
+type vec3 = [3]float64
+
+/*
+encodes a 4x4 block, with texels under half opacity made transparent. the
+colors start at the ends of the block's principal axis and are refined by
+least squares against the texels nearest each palette entry, judging every
+fit by its error after rounding the colors to RGB565. opaque blocks try both
+4 and 3 color palettes, as the midpoint entry sometimes fits better
+*/
+func encodeCMPRBlock(dst []byte, block *[16]texel) {
+	var opaque [16]vec3
+	numOpaque := 0
+	for _, t := range block {
+		if t[3] >= 128 {
+			opaque[numOpaque] = vec3{float64(t[0]), float64(t[1]), float64(t[2])}
+			numOpaque++
+		}
+	}
+	points := opaque[:numOpaque]
+	transparent := numOpaque < len(block)
+
+	var c0, c1 uint16
+	var indices, assigned [16]uint8
+	if len(points) > 0 {
+		lo, hi := principalEndpoints(points)
+		bestErr := math.Inf(1)
+		modes := [][]float64{cmprWeights3}
+		if !transparent {
+			modes = append(modes, cmprWeights4)
+		}
+		for _, weights := range modes {
+			a, b := hi, lo
+			for range CMPR_REFINE_ITERATIONS {
+				q0, q1, err := fitCMPRPalette(points, a, b, weights, assigned[:])
+				if err < bestErr {
+					bestErr = err
+					c0, c1 = q0, q1
+					n := 0
+					for i, t := range block {
+						if t[3] < 128 {
+							indices[i] = 3
+						} else {
+							indices[i] = assigned[n]
+							n++
+						}
+					}
+				}
+				var ok bool
+				if a, b, ok = leastSquaresEndpoints(points, assigned[:], weights, q0, q1); !ok {
+					break
+				}
+			}
+		}
+	} else {
+		for i := range indices {
+			indices[i] = 3
+		}
+	}
+
+	dst[0], dst[1] = byte(c0>>8), byte(c0)
+	dst[2], dst[3] = byte(c1>>8), byte(c1)
+	for y := range 4 {
+		var row byte
+		for x := range 4 {
+			row |= indices[y*4+x] << (6 - 2*x) // leftmost texel in the top bits
+		}
+		dst[4+y] = row
+	}
+}
+
+// the points furthest apart along the direction the points vary the most
+func principalEndpoints(points []vec3) (lo, hi vec3) {
+	var mean vec3
+	for _, p := range points {
+		for c := range 3 {
+			mean[c] += p[c] / float64(len(points))
+		}
+	}
+	var cov [3][3]float64
+	for _, p := range points {
+		for i := range 3 {
+			for j := range 3 {
+				cov[i][j] += (p[i] - mean[i]) * (p[j] - mean[j])
+			}
+		}
+	}
+	axis := vec3{1, 1, 1}
+	for range 8 { // power iteration
+		var next vec3
+		for i := range 3 {
+			next[i] = cov[i][0]*axis[0] + cov[i][1]*axis[1] + cov[i][2]*axis[2]
+		}
+		norm := math.Sqrt(next[0]*next[0] + next[1]*next[1] + next[2]*next[2])
+		if norm < 1e-9 {
+			break
+		}
+		axis = vec3{next[0] / norm, next[1] / norm, next[2] / norm}
+	}
+
+	minT, maxT := math.Inf(1), math.Inf(-1)
+	for _, p := range points {
+		t := (p[0]-mean[0])*axis[0] + (p[1]-mean[1])*axis[1] + (p[2]-mean[2])*axis[2]
+		if t < minT {
+			minT, lo = t, p
+		}
+		if t > maxT {
+			maxT, hi = t, p
+		}
+	}
+	return
+}
+
+func toRGB565(c vec3) uint16 {
+	var t texel
+	for i := range 3 {
+		t[i] = uint8(math.Round(math.Max(0, math.Min(255, c[i]))))
+	}
+	return rgb565(t)
+}
+
+func fromRGB565(v uint16) vec3 {
+	return vec3{
+		float64(expandChannel(v>>11, 5)),
+		float64(expandChannel(v>>5&0x3F, 6)),
+		float64(expandChannel(v&0x1F, 5)),
+	}
+}
+
+/*
+rounds colors `a` and `b` to RGB565 in the order the palette needs, and
+stores the palette entry nearest each point in `assigned`. returns the colors
+as stored and the total squared error
+*/
+func fitCMPRPalette(points []vec3, a vec3, b vec3, weights []float64, assigned []uint8) (q0 uint16, q1 uint16, err float64) {
+	q0, q1 = toRGB565(a), toRGB565(b)
+	if len(weights) == 4 && q0 < q1 || len(weights) == 3 && q0 > q1 {
+		q0, q1 = q1, q0
+	}
+	if len(weights) == 4 && q0 == q1 { // would read as 3 colors, which only differs in entries left unused
+		weights = weights[:2]
+	}
+
+	e0, e1 := fromRGB565(q0), fromRGB565(q1)
+	var palette [4]vec3
+	for i, w := range weights {
+		for c := range 3 {
+			palette[i][c] = e0[c] + w*(e1[c]-e0[c])
+		}
+	}
+	for n, p := range points {
+		best := math.Inf(1)
+		for i, q := range palette[:len(weights)] {
+			d := (p[0]-q[0])*(p[0]-q[0]) + (p[1]-q[1])*(p[1]-q[1]) + (p[2]-q[2])*(p[2]-q[2])
+			if d < best {
+				best, assigned[n] = d, uint8(i)
+			}
+		}
+		err += best
+	}
+	return
+}
+
+// the pair of colors that best reproduces the points given which palette
+// entry each one uses. not ok when every point uses the same position
+func leastSquaresEndpoints(points []vec3, assigned []uint8, weights []float64, q0 uint16, q1 uint16) (a vec3, b vec3, ok bool) {
+	if q0 == q1 {
+		weights = weights[:2]
+	}
+	var aa, ab, bb float64
+	var ap, bp vec3
+	for n, p := range points {
+		w := weights[assigned[n]]
+		aa += (1 - w) * (1 - w)
+		ab += (1 - w) * w
+		bb += w * w
+		for c := range 3 {
+			ap[c] += (1 - w) * p[c]
+			bp[c] += w * p[c]
+		}
+	}
+	det := aa*bb - ab*ab
+	if math.Abs(det) < 1e-9 {
+		return a, b, false
+	}
+	for c := range 3 {
+		a[c] = (bb*ap[c] - ab*bp[c]) / det
+		b[c] = (aa*bp[c] - ab*ap[c]) / det
+	}
+	return a, b, true
+}
+
+/*
+picks a format from what the image needs: grayscale images become I8, or IA8
+with alpha. color images become CMPR unless their alpha has levels between
+clear and opaque, which CMPR can't store, in which case they're RGB5A3
+*/
+func chooseTextureFormat(im *image.NRGBA) string {
+	gray, opaque, binaryAlpha := true, true, true
+	for i := 0; i < len(im.Pix); i += 4 {
+		r, g, b, a := im.Pix[i], im.Pix[i+1], im.Pix[i+2], im.Pix[i+3]
+		if a != 0 && (r != g || g != b) {
+			gray = false
+		}
+		if a != 255 {
+			opaque = false
+			if a != 0 {
+				binaryAlpha = false
+			}
+		}
+	}
+	switch {
+	case gray && opaque:
+		return "I8"
+	case gray:
+		return "IA8"
+	case binaryAlpha:
+		return "CMPR"
+	default:
+		return "RGB5A3"
+	}
+}
+
+// copies an image to non-premultiplied RGBA with its origin at 0, 0
+func toNRGBA(im image.Image) *image.NRGBA {
+	if nrgba, ok := im.(*image.NRGBA); ok && nrgba.Rect.Min == (image.Point{}) {
+		return nrgba
+	}
+	bounds := im.Bounds()
+	nrgba := image.NewNRGBA(image.Rect(0, 0, bounds.Dx(), bounds.Dy()))
+	draw.Draw(nrgba, nrgba.Rect, im, bounds.Min, draw.Src)
+	return nrgba
+}
+
+// an image encoded in a GX format
+type encodedTexture struct {
+	Data   []byte
+	Format uint32
+	Width  int
+	Height int
+}
+
+// about how many tiles each worker encodes at a time. textures are split into
+// bands of whole tile rows, so one large texture is spread across workers too
+const TEXTURE_BAND_TILES int = 256
+
+// calls fn with every number from 0 to n-1, on a worker per CPU
+func parallelFor(n int, fn func(i int)) {
+	var wg sync.WaitGroup
+	var next atomic.Int64
+	for range min(runtime.NumCPU(), n) {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := int(next.Add(1) - 1); i < n; i = int(next.Add(1) - 1) {
+				fn(i)
+			}
+		}()
+	}
+	wg.Wait()
+}
+
+// the encoded file of glTF image `idx`, PNG or JPEG
+func imageSource(doc *gltf.Document, idx int) (source []byte, err error) {
+	img := doc.Images[idx]
+	if img.BufferView == nil {
+		source, err = img.MarshalData()
+		if err != nil {
+			return nil, fmt.Errorf(`could not unmarshal texture source image (%w)`, err)
+		}
+		return source, nil
+	}
+	bv := doc.BufferViews[*img.BufferView]
+	return doc.Buffers[bv.Buffer].Data[bv.ByteOffset : bv.ByteOffset+bv.ByteLength], nil
+}
+
+/*
+decodes glTF images `sources` and encodes each in the format `formats` gives
+it, or one chosen from its contents. images are decoded in parallel, then
+their tiles are encoded in parallel straight into the output
+*/
+func encodeImages(doc *gltf.Document, sources []int, formats TextureFormats) (textures []encodedTexture, err error) {
+	images := make([]*image.NRGBA, len(sources))
+	names := make([]string, len(sources))
+	errs := make([]error, len(sources))
+	parallelFor(len(sources), func(i int) {
+		source, err := imageSource(doc, sources[i])
+		if err != nil {
+			errs[i] = err
+			return
+		}
+		decoded, _, err := image.Decode(bytes.NewReader(source))
+		if err != nil {
+			errs[i] = fmt.Errorf(`could not decode image (%w)`, err)
+			return
+		}
+		images[i] = toNRGBA(decoded)
+
+		name, ok := formats.Images[doc.Images[sources[i]].Name]
+		if !ok {
+			name = formats.Default
+		}
+		if name == "" {
+			name = chooseTextureFormat(images[i])
+		}
+		names[i] = name
+	})
+	if err = errors.Join(errs...); err != nil {
+		return nil, err
+	}
+
+	type band struct {
+		Texture        int
+		FirstRow, Rows int
+	}
+	bands := []band{}
+	textures = make([]encodedTexture, len(sources))
+	for i, im := range images {
+		f, ok := gxTextureFormats[names[i]]
+		if !ok {
+			return nil, fmt.Errorf(`unknown texture format '%s'`, names[i])
+		}
+		width, height := im.Rect.Dx(), im.Rect.Dy()
+		numTilesX := (width + f.TileWidth - 1) / f.TileWidth
+		numTilesY := (height + f.TileHeight - 1) / f.TileHeight
+		textures[i] = encodedTexture{
+			Data:   make([]byte, numTilesX*numTilesY*f.TileSize),
+			Format: f.Format,
+			Width:  width,
+			Height: height,
+		}
+		rows := max(1, TEXTURE_BAND_TILES/max(1, numTilesX))
+		for row := 0; row < numTilesY; row += rows {
+			bands = append(bands, band{i, row, min(rows, numTilesY-row)})
+		}
+	}
+	parallelFor(len(bands), func(i int) {
+		b := bands[i]
+		encodeTiles(images[b.Texture], gxTextureFormats[names[b.Texture]], textures[b.Texture].Data, b.FirstRow, b.Rows)
+	})
+	return textures, nil
+}
+
+/*
+encodes `rows` rows of tiles of an image in format `f`, from tile row
+`firstRow`, into `out`, which holds the whole image. tiles past the image's
+right and bottom edges repeat its edge texels
+*/
+func encodeTiles(im *image.NRGBA, f gxTextureFormat, out []byte, firstRow int, rows int) {
+	width, height := im.Rect.Dx(), im.Rect.Dy()
+	numTilesX := (width + f.TileWidth - 1) / f.TileWidth
+
+	var buf [64]texel
+	texels := buf[:f.TileWidth*f.TileHeight]
+	for tileY := firstRow; tileY < firstRow+rows; tileY++ {
+		for tileX := range numTilesX {
+			x0, y0 := tileX*f.TileWidth, tileY*f.TileHeight
+			for y := range f.TileHeight {
+				row := texels[y*f.TileWidth : (y+1)*f.TileWidth]
+				src := im.Pix[min(y0+y, height-1)*im.Stride:]
+				if x0+f.TileWidth <= width {
+					src = src[x0*4 : (x0+f.TileWidth)*4]
+					for x := range row {
+						row[x] = texel(src[x*4 : x*4+4])
+					}
+				} else {
+					for x := range row {
+						i := min(x0+x, width-1) * 4
+						row[x] = texel(src[i : i+4])
+					}
+				}
+			}
+			tile := tileY*numTilesX + tileX
+			f.Encode(out[tile*f.TileSize:(tile+1)*f.TileSize], texels)
+		}
+	}
+}
@@ -0,0 +1,301 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"sort"
+	"strings"
+)
+
+const TRACE_VERSION int = 1 // must match fst_trace_dump() in runtime/src/fst.c
+
+// one DVD read, as recorded by the runtime. times are in microseconds
+type TraceRead struct {
+	Entry      uint32 // index into the FST
+	Offset     uint32 // within the file
+	Length     uint32
+	DiscOffset uint32
+	Transfer   uint32 // reads merged into one drive command share this
+	Result     int32
+	Issued     uint64
+	Started    uint64
+	Completed  uint64
+}
+
+type TraceCmd struct {
+	Log   string  `arg:"" help:"Console log containing a trace dumped by the runtime" existingfile:""`
+	Image *string `help:"GCM image the trace was recorded with, to name files (defaults to game.gcm in the current directory)" optional:"" existingfile:""`
+	Order bool    `help:"Only print the files in the order they were first read, for the manifest's layout trace"`
+}
+
+// reads the last complete trace in a console log
+func readTrace(name string) (reads []TraceRead, err error) {
+	f, err := os.Open(name)
+	if err != nil {
+		return nil, fmt.Errorf(`failed to open trace (%w)`, err)
+	}
+	defer f.Close()
+
+	var current []TraceRead
+	inTrace := false
+	found := false
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		switch {
+		case strings.HasPrefix(line, "ORCA-TRACE-END"):
+			if inTrace {
+				reads = current
+				found = true
+			}
+			inTrace = false
+		case strings.HasPrefix(line, "ORCA-TRACE "):
+			var version int
+			var dropped uint32
+			_, err = fmt.Sscanf(line, "ORCA-TRACE %d %d", &version, &dropped)
+			if err != nil {
+				return nil, fmt.Errorf(`malformed trace header "%s"`, line)
+			}
+			if version != TRACE_VERSION {
+				return nil, fmt.Errorf(`unsupported trace version %d (expected %d)`, version, TRACE_VERSION)
+			}
+			if dropped > 0 {
+				fmt.Printf("Warning: the oldest %d reads were overwritten before the trace was dumped\n", dropped)
+			}
+			current = []TraceRead{}
+			inTrace = true
+		case inTrace && strings.HasPrefix(line, "R "):
+			var r TraceRead
+			_, err = fmt.Sscanf(line, "R %d %d %d %d %d %d %d %d %d", &r.Entry, &r.Offset, &r.Length, &r.DiscOffset,
+				&r.Transfer, &r.Result, &r.Issued, &r.Started, &r.Completed)
+			if err != nil {
+				return nil, fmt.Errorf(`malformed trace record "%s"`, line)
+			}
+			current = append(current, r)
+		}
+	}
+	if err = scanner.Err(); err != nil {
+		return nil, fmt.Errorf(`failed to read trace (%w)`, err)
+	}
+	if !found {
+		return nil, fmt.Errorf(`no trace found in "%s"`, name)
+	}
+	return
+}
+
+// full path of every FST entry in a GCM image, indexed like the FST
+func readGCMPaths(name string) (paths []string, err error) {
+	gcm, err := os.Open(name)
+	if err != nil {
+		return nil, fmt.Errorf(`failed to open GCM image (%w)`, err)
+	}
+	defer gcm.Close()
+
+	var area DiscSystemArea
+	err = binary.Read(gcm, binary.BigEndian, &area)
+	if err != nil {
+		return nil, fmt.Errorf(`failed to read GCM header (%w)`, err)
+	}
+	if area.DiscID.DVDMagicWord != GCM_MAGIC {
+		return nil, fmt.Errorf(`"%s" is not a GCM image`, name)
+	}
+	fst := make([]byte, area.BB2.FSTSize)
+	_, err = gcm.ReadAt(fst, int64(area.BB2.FSTOffset))
+	if err != nil {
+		return nil, fmt.Errorf(`failed to read FST (%w)`, err)
+	}
+
+	entry := func(i int) (e FSTEntry) {
+		e.Ident = binary.BigEndian.Uint32(fst[i*12:])
+		e.Offset = binary.BigEndian.Uint32(fst[i*12+4:])
+		e.Length = binary.BigEndian.Uint32(fst[i*12+8:])
+		return
+	}
+	numEntries := int(entry(0).Length)
+	stringTable := fst[numEntries*12:]
+	paths = make([]string, numEntries)
+	dirEnds := []int{numEntries}
+	dirPaths := []string{""}
+	for i := 1; i < numEntries; i++ {
+		for i >= dirEnds[len(dirEnds)-1] {
+			dirEnds = dirEnds[:len(dirEnds)-1]
+			dirPaths = dirPaths[:len(dirPaths)-1]
+		}
+		e := entry(i)
+		nameOffset := int(e.Ident & 0xFFFFFF)
+		nameLen := strings.IndexByte(string(stringTable[nameOffset:]), 0)
+		paths[i] = dirPaths[len(dirPaths)-1] + string(stringTable[nameOffset:nameOffset+nameLen])
+		if e.Ident>>24 == 1 {
+			dirEnds = append(dirEnds, int(e.Length))
+			dirPaths = append(dirPaths, paths[i]+"/")
+		}
+	}
+	return
+}
+
+type traceFileCost struct {
+	Path      string
+	Reads     int
+	Bytes     uint64
+	DriveTime float64 // transfer time, shared between merged reads by their length
+	Latency   uint64  // sum of issue to completion times
+	First     uint64
+	Last      uint64
+}
+
+func (r *TraceCmd) Run() error {
+	reads, err := readTrace(r.Log)
+	if err != nil {
+		return err
+	}
+	if len(reads) == 0 {
+		return fmt.Errorf(`trace is empty`)
+	}
+
+	image := "game.gcm"
+	if r.Image != nil {
+		image = *r.Image
+	}
+	var paths []string
+	if _, statErr := os.Stat(image); statErr == nil || r.Image != nil {
+		paths, err = readGCMPaths(image)
+		if err != nil {
+			return err
+		}
+	}
+	pathOf := func(entry uint32) string {
+		if int(entry) < len(paths) {
+			return paths[entry]
+		}
+		return fmt.Sprintf("#%d", entry)
+	}
+
+	if r.Order {
+		seen := map[uint32]bool{}
+		for _, read := range reads {
+			if !seen[read.Entry] {
+				seen[read.Entry] = true
+				fmt.Println(pathOf(read.Entry))
+			}
+		}
+		return nil
+	}
+
+	/* reads belonging to the same transfer were dispatched and completed together */
+	type transfer struct {
+		Started, Completed uint64
+		DiscOffset, End    uint32
+		Bytes              uint64
+	}
+	transfers := map[uint32]*transfer{}
+	for _, read := range reads {
+		t, ok := transfers[read.Transfer]
+		if !ok {
+			t = &transfer{Started: read.Started, Completed: read.Completed, DiscOffset: read.DiscOffset}
+			transfers[read.Transfer] = t
+		}
+		t.DiscOffset = min(t.DiscOffset, read.DiscOffset)
+		t.End = max(t.End, read.DiscOffset+read.Length)
+		t.Bytes += uint64(read.Length)
+	}
+	order := make([]uint32, 0, len(transfers))
+	for id := range transfers {
+		order = append(order, id)
+	}
+	sort.Slice(order, func(a, b int) bool { return order[a] < order[b] })
+
+	var busy, seekDistance uint64
+	seeks := 0
+	for i, id := range order {
+		t := transfers[id]
+		busy += t.Completed - t.Started
+		if i > 0 && transfers[order[i-1]].End != t.DiscOffset {
+			seeks++
+			prev := transfers[order[i-1]].End
+			if prev > t.DiscOffset {
+				seekDistance += uint64(prev - t.DiscOffset)
+			} else {
+				seekDistance += uint64(t.DiscOffset - prev)
+			}
+		}
+	}
+
+	begin, end := reads[0].Issued, reads[0].Completed
+	var bytes uint64
+	failed := 0
+	files := map[uint32]*traceFileCost{}
+	for _, read := range reads {
+		begin = min(begin, read.Issued)
+		end = max(end, read.Completed)
+		bytes += uint64(read.Length)
+		if read.Result < 0 {
+			failed++
+		}
+
+		f, ok := files[read.Entry]
+		if !ok {
+			f = &traceFileCost{Path: pathOf(read.Entry), First: read.Issued}
+			files[read.Entry] = f
+		}
+		t := transfers[read.Transfer]
+		f.Reads++
+		f.Bytes += uint64(read.Length)
+		f.DriveTime += float64(t.Completed-t.Started) * float64(read.Length) / float64(t.Bytes)
+		f.Latency += read.Completed - read.Issued
+		f.First = min(f.First, read.Issued)
+		f.Last = max(f.Last, read.Completed)
+	}
+	span := end - begin
+
+	fmt.Printf("Reads:      %d in %d transfers", len(reads), len(transfers))
+	if failed > 0 {
+		fmt.Printf(" (%d failed)", failed)
+	}
+	fmt.Println()
+	fmt.Printf("Bytes read: %d\n", bytes)
+	fmt.Printf("Seeks:      %d, %d bytes in total\n", seeks, seekDistance)
+	fmt.Printf("Elapsed:    %.3f ms\n", float64(span)/1000)
+	fmt.Printf("Drive busy: %.3f ms", float64(busy)/1000)
+	if busy > 0 {
+		fmt.Printf(" (%.0f KiB/s)", float64(bytes)/1024/(float64(busy)/1e6))
+	}
+	fmt.Println()
+	if span > busy {
+		fmt.Printf("Drive idle: %.3f ms\n", float64(span-busy)/1000)
+	} else {
+		fmt.Printf("Drive idle: 0 ms\n")
+	}
+
+	costs := make([]*traceFileCost, 0, len(files))
+	for _, f := range files {
+		costs = append(costs, f)
+	}
+	sort.Slice(costs, func(a, b int) bool { return costs[a].DriveTime > costs[b].DriveTime })
+	fmt.Println()
+	fmt.Printf("%-40s %8s %12s %12s %12s %12s\n", "File", "Reads", "Bytes", "Drive ms", "Latency ms", "Span ms")
+	for _, f := range costs {
+		fmt.Printf("%-40s %8d %12d %12.3f %12.3f %12.3f\n", f.Path, f.Reads, f.Bytes,
+			f.DriveTime/1000, float64(f.Latency)/1000, float64(f.Last-f.First)/1000)
+	}
+	return nil
+}
@@ -0,0 +1,168 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+package main
+
+import "encoding/binary"
+
+const YAZ0_HEADER_SIZE int = 16
+const YAZ0_WINDOW int = 0x1000
+const YAZ0_MIN_MATCH int = 3
+const YAZ0_MAX_MATCH int = 0xFF + 0x12
+const YAZ0_MAX_CHAIN int = 256 // candidates searched per position
+
+// bytes the runtime allocates past a compressed blob's decompressed size, so
+// that it can be decompressed in place. must match YAZ0_SLACK in runtime/include/yaz0.h
+const YAZ0_SLACK int = 128
+
+func roundUp32(n int) int {
+	return (n + 31) &^ 31
+}
+
+// longest match for src[pos:] within the window, following hash chains
+func yaz0FindMatch(src []byte, pos int, head []int32, prev []int32) (length int, distance int) {
+	if pos+YAZ0_MIN_MATCH > len(src) {
+		return 0, 0
+	}
+	maxLength := min(YAZ0_MAX_MATCH, len(src)-pos)
+	candidate := int(head[yaz0Hash(src, pos)])
+	for chain := 0; candidate >= 0 && pos-candidate <= YAZ0_WINDOW && chain < YAZ0_MAX_CHAIN; chain++ {
+		n := 0
+		for n < maxLength && src[candidate+n] == src[pos+n] {
+			n++
+		}
+		if n > length {
+			length = n
+			distance = pos - candidate
+			if n == maxLength {
+				break
+			}
+		}
+		candidate = int(prev[candidate])
+	}
+	if length < YAZ0_MIN_MATCH {
+		return 0, 0
+	}
+	return
+}
+
+func yaz0Hash(src []byte, pos int) int {
+	return (int(src[pos])<<10 ^ int(src[pos+1])<<5 ^ int(src[pos+2])) & 0x7FFF
+}
+
+// compresses `src` as a Yaz0 stream, choosing matches greedily with one
+// position of lookahead
+func yaz0Compress(src []byte) (out []byte) {
+	out = []byte{'Y', 'a', 'z', '0'}
+	out = binary.BigEndian.AppendUint32(out, uint32(len(src)))
+	out = append(out, make([]byte, 8)...)
+
+	head := make([]int32, 0x8000)
+	for i := range head {
+		head[i] = -1
+	}
+	prev := make([]int32, len(src))
+	insert := func(pos int) {
+		if pos+YAZ0_MIN_MATCH <= len(src) {
+			h := yaz0Hash(src, pos)
+			prev[pos] = head[h]
+			head[h] = int32(pos)
+		}
+	}
+
+	groupHeader := 0
+	bits := 8
+	for pos := 0; pos < len(src); {
+		if bits == 8 {
+			groupHeader = len(out)
+			out = append(out, 0)
+			bits = 0
+		}
+
+		length, distance := yaz0FindMatch(src, pos, head, prev)
+		if length > 0 && length < YAZ0_MAX_MATCH {
+			insert(pos)
+			// a literal followed by a longer match is cheaper
+			if next, _ := yaz0FindMatch(src, pos+1, head, prev); next > length+1 {
+				length = 0
+			}
+		} else {
+			insert(pos)
+		}
+
+		if length == 0 {
+			out[groupHeader] |= 0x80 >> bits
+			out = append(out, src[pos])
+			pos++
+		} else {
+			d := distance - 1
+			if length >= 0x12 {
+				out = append(out, uint8(d>>8), uint8(d), uint8(length-0x12))
+			} else {
+				out = append(out, uint8((length-2)<<4|d>>8), uint8(d))
+			}
+			for i := pos + 1; i < pos+length; i++ {
+				insert(i)
+			}
+			pos += length
+		}
+		bits++
+	}
+	return
+}
+
+/*
+ * the runtime reads a compressed blob into the end of its destination buffer,
+ * ROUNDUP32(rawSize) + YAZ0_SLACK bytes long, and decompresses it from there
+ * towards the start. this replays that decompression and reports whether the
+ * output ever overtakes input that hasn't been read yet.
+ */
+func yaz0DecodesInPlace(stream []byte, rawSize int) bool {
+	base := roundUp32(rawSize) + YAZ0_SLACK - roundUp32(len(stream)) // where the stream is read to
+	in := YAZ0_HEADER_SIZE
+	out := 0
+	var code uint8
+	bits := 0
+	for out < rawSize {
+		if bits == 0 {
+			code = stream[in]
+			in++
+			bits = 8
+		}
+		n := 1
+		if code&0x80 != 0 {
+			in++
+		} else {
+			n = int(stream[in] >> 4)
+			in += 2
+			if n == 0 {
+				n = int(stream[in]) + 0x12
+				in++
+			} else {
+				n += 2
+			}
+		}
+		out += n
+		if out > base+in {
+			return false
+		}
+		code <<= 1
+		bits--
+	}
+	return true
+}
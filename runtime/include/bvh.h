@@ -0,0 +1,46 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <gccore.h>
+#include "pak.h"
+
+/*
+ * Spatial queries against a model's BVH. Only nodes that haven't moved since the model was first drawn are found, as
+ * the hierarchy is built from where the composer placed them.
+ */
+
+struct BVHHit {
+	struct Node*          node;
+	struct MeshPrimitive* primitive;
+	float                 distance; // Along the ray, in multiples of its direction vector
+};
+
+/*
+ * Finds the closest triangle hit by the ray origin + t * direction for 0 <= t <= maxDistance. Returns false if nothing
+ * was hit, or if the model has no BVH.
+ */
+bool bvh_raycast(struct Model* model, guVector const* origin, guVector const* direction, float maxDistance,
+                 struct BVHHit* hit);
+
+/*
+ * Stores up to `max` primitives whose world space bounding box contains `point` in `hits` and returns how many were
+ * found in total, which may exceed `max`. `distance` is 0 for every hit.
+ */
+size_t bvh_query_point(struct Model* model, guVector const* point, struct BVHHit* hits, size_t max);
@@ -28,10 +28,38 @@ struct FSTEntry {
 
 typedef void (*fstreadcb)(s32 bytes_read, void* ud);
 
+#define FST_BUSY (-2) // fst_read_async() has no free read slots; retry once a pending read completes
+
+struct FSTStats {
+	u32 queueDepth;     // Reads waiting for the drive
+	u32 maxQueueDepth;  // Most reads that were ever waiting at once
+	u32 requests;       // Reads made
+	u32 transfers;      // Commands sent to the drive, after merging
+	u64 bytesRead;      // Requested bytes delivered
+	u32 bytesPerSecond; // bytesRead over the time the drive was busy
+	u32 poolCapacity;   // Reads that can be pending at once, as passed to fst_init()
+	u32 poolInUse;      // Reads pending or in flight
+	u32 poolPeak;       // Most reads that were ever pending or in flight at once
+	u32 poolExhausted;  // Reads turned away with FST_BUSY
+};
+
 bool             fst_is_directory(struct FSTEntry* entry);
 size_t           fst_get_bufsz(struct FSTEntry* entry);
 char*            fst_get_filename(struct FSTEntry* entry);
 struct FSTEntry* fst_resolve_path(char* path);
 int  fst_read_async(struct FSTEntry* entry, void* buffer, size_t length, off_t offset, fstreadcb cb, void* ud);
 int  fst_read_sync(struct FSTEntry* entry, void* buffer, size_t length, off_t offset);
-void fst_init(void);
+void fst_init(size_t maxReads);
+
+struct FSTStats const* fst_get_stats(void);
+
+/* Records every read for `orca trace`. Always on in debug builds, or enable with `xmake f --fst_trace=y` */
+#if defined(DEBUG) && !defined(FST_TRACE)
+#define FST_TRACE
+#endif
+#ifdef FST_TRACE
+#define FST_TRACE_SIZE 1024 // Most recent reads kept
+
+/* Prints the recorded reads to the console, oldest first */
+void fst_trace_dump(void);
+#endif
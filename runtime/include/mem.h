@@ -22,9 +22,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 extern void* g_XFB0;
 extern void* g_FIFO;
 
-void  mem_checkOOM(void* p);
-void  mem_checkalign(void* p, size_t alignment, char const* info);
-void  mem_preinit(void);
-void  mem_init(size_t heapSize);
-void* mem_alloc_scratch(size_t n, size_t align);
-void  mem_reset_scratch(void);
+void   mem_checkOOM(void* p);
+void   mem_checkalign(void* p, size_t alignment, char const* info);
+void   mem_preinit(void);
+void   mem_init(size_t heapSize);
+void*  mem_alloc_scratch(size_t n, size_t align);
+void   mem_reset_scratch(void);
+size_t mem_get_scratch_free(void);
+void*  mem_alloc_frame(size_t n, size_t align);
+void   mem_reset_frame(void);
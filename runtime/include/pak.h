@@ -27,7 +27,8 @@ enum ComponentType {
 	COMPONENT_U8 = GX_U8,
 	COMPONENT_S16 = GX_S16,
 	COMPONENT_U16 = GX_U16,
-	COMPONENT_U32 // Not a supported GX component type. Used for accessors containing indices.
+	COMPONENT_U32 = 5,  // Not a supported GX component type. Used for accessors containing indices.
+	COMPONENT_COLOR = 6 // Vertex colors packed by the composer in the GX color format `colorFormat`
 };
 
 enum TexFormat {
@@ -55,24 +56,52 @@ enum WrapMode { WRAP_CLAMP = GX_CLAMP, WRAP_REPEAT = GX_REPEAT, WRAP_MIRROR = GX
 
 enum ElementType { ELEM_SCALAR, ELEM_VEC2, ELEM_VEC3, ELEM_VEC4, ELEM_MAT2, ELEM_MAT3, ELEM_MAT4 };
 
+/*
+ * The structs below are also the PAK's on-disc layout: a model's tables are read into memory as they are and fixed up
+ * in place. On disc, string pointers hold offsets into the string table, table pointers hold offsets from the start of
+ * the model, pointers to table elements hold indices (UINT32_MAX for NULL) and data pointers hold PAK file offsets.
+ * Fields marked as runtime state are zero on disc. composer/pak.go must be kept in sync with any change here.
+ */
+
 struct Accessor {
 	char const*        name;
-	void*              buffer;
+	void*              buffer; // Read separately, unless interleaved
+	/*
+	 * Accessor whose buffer holds this one's elements interleaved with its own, NULL if it has a buffer of its own.
+	 * Both share a stride, and `buffer` is stored on disc as the byte offset of this accessor's first element in it
+	 */
+	struct Accessor*   interleavedWith;
+	uint32_t           compressedSize; // Size of the Yaz0 stream on disc, 0 if stored raw
 	size_t             count;
 	size_t             stride;
 	enum ComponentType componentType;
 	enum ElementType   elementType;
+	uint8_t            frac;        // Fractional bits of S8/S16 fixed point components, 0 for other types
+	uint8_t            colorFormat; // GX_RGB565 to GX_RGBA8 for COMPONENT_COLOR, 0 for other types
 };
 
 struct Material {
 	char const*    name;
-	GXTexObj*      texture;
+	GXTexObj*      texture; // Runtime state
+	void*          image;   // Read separately
+	uint32_t       imageSize;
+	uint32_t       compressedSize; // Size of the Yaz0 stream on disc, 0 if stored raw
+	uint16_t       width;
+	uint16_t       height;
 	enum WrapMode  wrapS;
 	enum WrapMode  wrapT;
 	enum TexFormat format;
 	uint8_t        texCoord;
 };
 
+/* GX attribute type (GX_NONE, GX_DIRECT, GX_INDEX8 or GX_INDEX16) of each vertex component */
+struct VtxDesc {
+	uint8_t position;
+	uint8_t normal;
+	uint8_t color0;
+	uint8_t texCoord0;
+};
+
 struct MeshPrimitive {
 	struct Accessor*   attrPos;
 	struct Accessor*   attrNormal;
@@ -85,6 +114,15 @@ struct MeshPrimitive {
 	struct Accessor*   indices;
 	struct Material*   material;
 	enum PrimitiveMode mode;
+	/*
+	 * Precompiled GX display list (32B-aligned), NULL if drawn in immediate mode. On disc, an offset into the model's
+	 * display list table
+	 */
+	void*          displayList;
+	size_t         displayListSize;
+	struct VtxDesc desc;      // Vertex descriptor the display list was recorded with
+	guVector       boundsMin; // POSITION bounding box in mesh space, inverted if unknown
+	guVector       boundsMax;
 };
 
 struct Mesh {
@@ -96,11 +134,48 @@ struct Mesh {
 struct Node {
 	char const*  name;
 	struct Mesh* mesh;
+	struct Node* parent;
 	uint32_t*    childrenIdxs;
 	size_t       numChildren;
 	guQuaternion rotation;
 	guVector     scale;
 	guVector     translation;
+	/* Sphere around the node's own mesh in node space; the radius is negative if the node has no mesh */
+	guVector boundsCenter;
+	float    boundsRadius;
+
+	/* Runtime state */
+	bool dirty; // Set after changing rotation, scale or translation so the cached matrices below are recomputed
+	/*
+	 * Set once the node's world matrix changes after the model was first drawn. The model's BVH was built with nodes
+	 * where the composer placed them, so moved nodes are culled through the node tree instead.
+	 */
+	bool     moved;
+	bool     movedSubtree;        // The node or one of its descendants has moved
+	uint32_t modelViewGeneration; // Camera modelView was computed with, 0 if stale
+	/* Sphere around the node and all of its descendants in world space, kept up to date with the world matrix */
+	guVector worldCenter;
+	float    worldRadius;
+	Mtx      local;     // scale, rotation, then translation
+	Mtx      world;     // parent->world * local
+	Mtx      modelView; // camera * world
+};
+
+#define BVH_MAX_DEPTH 32 // Deepest BVH the composer builds, so walks can use a fixed-size stack
+
+/* Bounding volume hierarchy node, exactly one cache line */
+struct BVHNode {
+	guVector min; // World space bounding box of everything below this node
+	guVector max;
+	uint32_t first; // Internal nodes: index of the right child; the left child directly follows. Leaves: first item
+	uint32_t count; // Number of items in a leaf, 0 for internal nodes
+};
+_Static_assert(sizeof(struct BVHNode) == 32, "BVH nodes must fill exactly one cache line");
+
+/* A primitive as instanced by a node, indices into the model's node and primitive tables */
+struct BVHItem {
+	uint32_t node;
+	uint32_t primitive;
 };
 
 struct Scene {
@@ -109,6 +184,7 @@ struct Scene {
 	size_t      numNodes;
 };
 
+/* Header of a model's tables, which follow it in the same allocation */
 struct Model {
 	uint32_t*             idxs;
 	struct Node*          nodes;
@@ -117,6 +193,8 @@ struct Model {
 	struct MeshPrimitive* primitives;
 	struct Accessor*      accessors;
 	struct Scene*         scenes;
+	struct BVHNode*       bvh; // Over every primitive instance in the model's scenes, NULL if there is none
+	struct BVHItem*       bvhItems;
 	size_t                numIdxs;
 	size_t                numNodes;
 	size_t                numMeshes;
@@ -124,6 +202,11 @@ struct Model {
 	size_t                numPrimitives;
 	size_t                numAccessors;
 	size_t                numScenes;
+	size_t                numBVHNodes;
+	size_t                numBVHItems;
+	void*                 displayLists; // Read separately
+	size_t                displayListsSize;
+	bool                  posed; // Runtime state: world matrices have been computed at least once
 };
 
 struct Asset {
@@ -133,9 +216,21 @@ struct Asset {
 };
 
 struct Level {
+	uint16_t      version;
 	char*         stringTable;
 	struct Asset* assets;
 	size_t        numAssets;
 };
 
+struct PAKLoader;
+
+/*
+ * Starts loading a level in the background, returning NULL if it doesn't exist. pak_poll() must be called regularly
+ * (e.g. once a frame) until it returns true, after which pak_finish() returns the level and frees the loader.
+ */
+struct PAKLoader* pak_load_async(char* levelName);
+bool              pak_poll(struct PAKLoader* loader);
+float             pak_get_progress(struct PAKLoader const* loader); // 0 to 1
+struct Level*     pak_finish(struct PAKLoader* loader);
+/* Loads a level, blocking until it is done */
 struct Level* pak_load(char* levelName);
@@ -21,10 +21,22 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <gccore.h>
 #include "pak.h"
 
+struct RenderStats {
+	uint32_t gxCommands;        // GX state commands sent during the last frame
+	uint32_t gxCommandsSkipped; // GX state commands dropped as redundant
+	uint32_t primitives;        // Primitives drawn
+	uint32_t primitivesCulled;  // Primitives outside the view frustum
+	uint32_t subtreesCulled;    // Nodes whose whole subtree was outside the view frustum
+};
+
 size_t render_get_xfbsz(void);
 size_t render_get_fifosz(void);
 
 void render_init(void);
 void render_ready(void);
+void render_loading(float progress);
 void render_set_camera(Mtx camera);
+void render_prepare_model(struct Model* model);
 void render_tick(struct Model* model);
+
+struct RenderStats const* render_get_stats(void);
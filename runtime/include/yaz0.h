@@ -0,0 +1,37 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define YAZ0_HEADER_SIZE 16
+/*
+ * Bytes allocated past a compressed blob's decompressed size, so that it can be read into the end of its own
+ * destination and decompressed in place. The composer only compresses blobs for which this is enough. Must match
+ * YAZ0_SLACK in composer/yaz0.go
+ */
+#define YAZ0_SLACK 128
+
+/* Decompressed size of a Yaz0 stream */
+uint32_t yaz0_get_size(void const* src);
+/*
+ * Decompresses a Yaz0 stream into dst. The stream may lie within dst itself, as long as the output never overtakes
+ * input that hasn't been read yet.
+ */
+void yaz0_decode(void const* src, void* dst);
@@ -0,0 +1,267 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <gccore.h>
+#include "bvh.h"
+#include "pak.h"
+
+struct Ray {
+	guVector origin;
+	guVector direction;
+	guVector invDirection;
+};
+
+static float dot(guVector const* a, guVector const* b) {
+	return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+static guVector sub(guVector const* a, guVector const* b) {
+	return (guVector){a->x - b->x, a->y - b->y, a->z - b->z};
+}
+
+static guVector cross(guVector const* a, guVector const* b) {
+	return (guVector){a->y * b->z - a->z * b->y, a->z * b->x - a->x * b->z, a->x * b->y - a->y * b->x};
+}
+
+static struct Ray make_ray(guVector const* origin, guVector const* direction) {
+	return (struct Ray){
+	    .origin = *origin,
+	    .direction = *direction,
+	    .invDirection = {1.0F / direction->x, 1.0F / direction->y, 1.0F / direction->z},
+	};
+}
+
+/* Slab test; returns the distance at which the ray enters the box, or INFINITY if it misses it within maxDistance */
+static float ray_box(struct Ray const* ray, guVector const* min, guVector const* max, float maxDistance) {
+	float enter = 0;
+	float exit = maxDistance;
+	float const o[3] = {ray->origin.x, ray->origin.y, ray->origin.z};
+	float const inv[3] = {ray->invDirection.x, ray->invDirection.y, ray->invDirection.z};
+	float const lo[3] = {min->x, min->y, min->z};
+	float const hi[3] = {max->x, max->y, max->z};
+	for (int i = 0; i < 3; i++) {
+		float t0 = (lo[i] - o[i]) * inv[i];
+		float t1 = (hi[i] - o[i]) * inv[i];
+		if (t0 > t1) {
+			float const t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		enter = fmaxf(enter, t0);
+		exit = fminf(exit, t1);
+		if (enter > exit) return INFINITY;
+	}
+	return enter;
+}
+
+/* Möller–Trumbore, hitting both faces; returns INFINITY on a miss */
+static float ray_triangle(struct Ray const* ray, guVector const* a, guVector const* b, guVector const* c) {
+	static float const EPSILON = 1E-7F;
+	guVector const     e1 = sub(b, a);
+	guVector const     e2 = sub(c, a);
+	guVector const     p = cross(&ray->direction, &e2);
+	float const        det = dot(&e1, &p);
+	if (fabsf(det) < EPSILON) return INFINITY; // Parallel to the triangle
+
+	float const    invDet = 1.0F / det;
+	guVector const s = sub(&ray->origin, a);
+	float const    u = dot(&s, &p) * invDet;
+	if (u < 0 || u > 1) return INFINITY;
+	guVector const q = cross(&s, &e1);
+	float const    v = dot(&ray->direction, &q) * invDet;
+	if (v < 0 || u + v > 1) return INFINITY;
+	float const t = dot(&e2, &q) * invDet;
+	return t >= 0 ? t : INFINITY;
+}
+
+static guVector read_position(struct Accessor const* acr, uint32_t idx) {
+	void const* const elem = (uint8_t const*)acr->buffer + idx * acr->stride;
+	float const       scale = 1.0F / (float)(1U << acr->frac); // Fixed point components are shifted like GX does
+	switch (acr->componentType) {
+	case COMPONENT_F32:
+		return (guVector){((float const*)elem)[0], ((float const*)elem)[1], ((float const*)elem)[2]};
+	case COMPONENT_S16:
+		return (guVector){((int16_t const*)elem)[0] * scale, ((int16_t const*)elem)[1] * scale,
+		                  ((int16_t const*)elem)[2] * scale};
+	case COMPONENT_U16:
+		return (guVector){((uint16_t const*)elem)[0] * scale, ((uint16_t const*)elem)[1] * scale,
+		                  ((uint16_t const*)elem)[2] * scale};
+	case COMPONENT_S8:
+		return (guVector){((int8_t const*)elem)[0] * scale, ((int8_t const*)elem)[1] * scale,
+		                  ((int8_t const*)elem)[2] * scale};
+	case COMPONENT_U8:
+		return (guVector){((uint8_t const*)elem)[0] * scale, ((uint8_t const*)elem)[1] * scale,
+		                  ((uint8_t const*)elem)[2] * scale};
+	default:
+		printf("ERROR: Invalid POSITION component type: '%d'", acr->componentType);
+		exit(1);
+	}
+}
+
+static uint32_t vertex_index(struct MeshPrimitive const* p, size_t i) {
+	return p->indices == NULL ? i : ((uint16_t const*)p->indices->buffer)[i];
+}
+
+/* Closest hit of a ray given in the primitive's mesh space against its triangles, INFINITY on a miss */
+static float ray_primitive(struct Ray const* ray, struct MeshPrimitive const* p, float maxDistance) {
+	size_t const count = p->indices != NULL ? p->indices->count : p->attrPos->count;
+	float        closest = INFINITY;
+	size_t       numTriangles = 0;
+	switch (p->mode) {
+	case MODE_TRIANGLES:
+		numTriangles = count / 3;
+		break;
+	case MODE_TRIANGLE_STRIP:
+	case MODE_TRIANGLE_FAN:
+		numTriangles = count < 3 ? 0 : count - 2;
+		break;
+	default:
+		return INFINITY; // Points and lines have no area to hit
+	}
+
+	for (size_t i = 0; i < numTriangles; i++) {
+		size_t corners[3];
+		switch (p->mode) {
+		case MODE_TRIANGLE_STRIP:
+			corners[0] = i, corners[1] = i + 1, corners[2] = i + 2;
+			break;
+		case MODE_TRIANGLE_FAN:
+			corners[0] = 0, corners[1] = i + 1, corners[2] = i + 2;
+			break;
+		default:
+			corners[0] = i * 3, corners[1] = i * 3 + 1, corners[2] = i * 3 + 2;
+			break;
+		}
+		guVector const a = read_position(p->attrPos, vertex_index(p, corners[0]));
+		guVector const b = read_position(p->attrPos, vertex_index(p, corners[1]));
+		guVector const c = read_position(p->attrPos, vertex_index(p, corners[2]));
+		float const    t = ray_triangle(ray, &a, &b, &c);
+		if (t <= maxDistance && t < closest) closest = t;
+	}
+	return closest;
+}
+
+/* World space bounding box of a primitive as placed by `node`, false if its bounds are unknown */
+static bool item_bounds(struct Node* node, struct MeshPrimitive const* p, guVector* min, guVector* max) {
+	if (p->boundsMin.x > p->boundsMax.x) return false;
+
+	guVector center = {(p->boundsMin.x + p->boundsMax.x) / 2, (p->boundsMin.y + p->boundsMax.y) / 2,
+	                   (p->boundsMin.z + p->boundsMax.z) / 2};
+	guVector const half = {(p->boundsMax.x - p->boundsMin.x) / 2, (p->boundsMax.y - p->boundsMin.y) / 2,
+	                       (p->boundsMax.z - p->boundsMin.z) / 2};
+	MtxP const     world = node->world;
+	guVecMultiply(world, &center, &center);
+	guVector const extent = {
+	    fabsf(world[0][0]) * half.x + fabsf(world[0][1]) * half.y + fabsf(world[0][2]) * half.z,
+	    fabsf(world[1][0]) * half.x + fabsf(world[1][1]) * half.y + fabsf(world[1][2]) * half.z,
+	    fabsf(world[2][0]) * half.x + fabsf(world[2][1]) * half.y + fabsf(world[2][2]) * half.z,
+	};
+	*min = sub(&center, &extent);
+	*max = (guVector){center.x + extent.x, center.y + extent.y, center.z + extent.z};
+	return true;
+}
+
+bool bvh_raycast(struct Model* model, guVector const* origin, guVector const* direction, float maxDistance,
+                 struct BVHHit* hit) {
+	if (model->bvh == NULL) return false;
+
+	struct Ray const ray = make_ray(origin, direction);
+	float            closest = maxDistance;
+	bool             found = false;
+
+	uint32_t stack[BVH_MAX_DEPTH];
+	size_t   top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		struct BVHNode const* const b = model->bvh + stack[--top];
+		if (ray_box(&ray, &b->min, &b->max, closest) == INFINITY) continue;
+
+		if (b->count == 0) {
+			stack[top++] = b->first;
+			stack[top++] = (uint32_t)(b - model->bvh) + 1;
+			continue;
+		}
+		for (struct BVHItem const* item = model->bvhItems + b->first; item < model->bvhItems + b->first + b->count;
+		     item++) {
+			struct Node* const                node = model->nodes + item->node;
+			struct MeshPrimitive const* const p = model->primitives + item->primitive;
+			if (node->moved || p->attrPos == NULL) continue;
+			guVector min, max;
+			if (item_bounds(node, p, &min, &max) && ray_box(&ray, &min, &max, closest) == INFINITY) continue;
+
+			/* Affine maps preserve the ray parameter, so a hit in mesh space is at the same distance in world space */
+			Mtx inverse;
+			if (!guMtxInverse(node->world, inverse)) continue;
+			guVector localOrigin = *origin;
+			guVector localDirection = *direction;
+			guVecMultiply(inverse, &localOrigin, &localOrigin);
+			guVecMultiplySR(inverse, &localDirection, &localDirection);
+			struct Ray const local = make_ray(&localOrigin, &localDirection);
+
+			float const t = ray_primitive(&local, p, closest);
+			if (t < INFINITY) {
+				closest = t;
+				found = true;
+				hit->node = node;
+				hit->primitive = model->primitives + item->primitive;
+				hit->distance = t;
+			}
+		}
+	}
+	return found;
+}
+
+size_t bvh_query_point(struct Model* model, guVector const* point, struct BVHHit* hits, size_t max) {
+	if (model->bvh == NULL) return 0;
+
+	size_t   found = 0;
+	uint32_t stack[BVH_MAX_DEPTH];
+	size_t   top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		struct BVHNode const* const b = model->bvh + stack[--top];
+		if (point->x < b->min.x || point->y < b->min.y || point->z < b->min.z || point->x > b->max.x ||
+		    point->y > b->max.y || point->z > b->max.z) {
+			continue;
+		}
+
+		if (b->count == 0) {
+			stack[top++] = b->first;
+			stack[top++] = (uint32_t)(b - model->bvh) + 1;
+			continue;
+		}
+		for (struct BVHItem const* item = model->bvhItems + b->first; item < model->bvhItems + b->first + b->count;
+		     item++) {
+			struct Node* const          node = model->nodes + item->node;
+			struct MeshPrimitive* const p = model->primitives + item->primitive;
+			if (node->moved) continue;
+			guVector lo, hi;
+			if (!item_bounds(node, p, &lo, &hi)) continue;
+			if (point->x < lo.x || point->y < lo.y || point->z < lo.z || point->x > hi.x || point->y > hi.y ||
+			    point->z > hi.z) {
+				continue;
+			}
+
+			if (found < max) hits[found] = (struct BVHHit){.node = node, .primitive = p, .distance = 0};
+			found++;
+		}
+	}
+	return found;
+}
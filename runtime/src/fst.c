@@ -22,17 +22,110 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <gccore.h>
 #include "fst.h"
 #include "orca.h"
+#include "mem.h"
 
 static struct FSTEntry** const FSTBase = (void*)0x80000038;
 
 /* String table is located immediately above FST entries */
 #define STRING_TABLE ((char*)(*FSTBase + (*FSTBase)->length))
 
-struct ExtDVDUD { /* extended DVD userdata */
-	fstreadcb cb;
-	void*     ud;
+#define FST_BOUNCE_SIZE 0x10000 // 64KiB, largest merged transfer
+#define FST_MERGE_GAP   0x4000  // 16KiB, largest gap read through rather than seeking past
+
+/* A read waiting for, or part of, a transfer. Taken from a fixed pool so reads never touch the heap */
+struct FSTRequest {
+	struct FSTRequest* next;
+	void*              buffer;
+	u32                length;
+	u32                discOffset;
+	fstreadcb          cb;
+	void*              ud;
+#ifdef FST_TRACE
+	u32 entry;  // Index into the FST
+	u32 offset; // Within the file
+	u64 issued;
+#endif
 };
 
+/*
+ * Reads are not sent to the drive in the order they are made. They are queued sorted by disc offset, and whenever the
+ * drive is idle the next transfer is taken in elevator order: the first pending read at or after where the previous
+ * transfer ended, wrapping around to the start of the disc once none remain ahead. Pending reads that lie within
+ * FST_MERGE_GAP of each other are merged into one transfer through the bounce buffer, then copied to their buffers.
+ * The queue is shared with the DVD interrupt, so it's only touched with interrupts disabled.
+ */
+static struct FSTRequest* pending = NULL; // Sorted by discOffset
+static struct {
+	dvdcmdblk          block;
+	struct FSTRequest* requests; // NULL if the drive is idle
+	u32                discOffset;
+	u32                length;
+	bool               bounced;
+	u64                start;
+} transfer;
+static u8 bounce[FST_BOUNCE_SIZE] __attribute__((aligned(32)));
+static u32 head = 0; // Disc offset the last transfer ended at
+
+static struct FSTRequest* pool = NULL;
+static struct FSTRequest* freeRequests = NULL; // Unused slots of pool, linked through next
+static lwpq_t             poolQueue;           // fst_read_sync() waits here for a slot to be freed
+
+static struct FSTStats stats;
+static u64             busyMicroseconds = 0;
+
+#ifdef FST_TRACE
+struct FSTTraceRecord {
+	u32 entry;
+	u32 offset;
+	u32 length;
+	u32 discOffset;
+	u32 transfer; // Sequence number of the transfer that read it
+	s32 result;
+	u64 issued;
+	u64 started;
+	u64 completed;
+};
+
+static struct FSTTraceRecord trace[FST_TRACE_SIZE];
+static u32                   traceCount = 0; // Reads recorded so far, the oldest are overwritten
+
+static void trace_read(struct FSTRequest const* request, s32 result, u64 completed) {
+	trace[traceCount % FST_TRACE_SIZE] = (struct FSTTraceRecord){
+	    .entry = request->entry,
+	    .offset = request->offset,
+	    .length = request->length,
+	    .discOffset = request->discOffset,
+	    .transfer = stats.transfers,
+	    .result = result,
+	    .issued = request->issued,
+	    .started = transfer.start,
+	    .completed = completed,
+	};
+	traceCount++;
+}
+
+/*
+ * One line per read, bracketed by markers so the dump can be cut out of a console log. Times are in microseconds.
+ * Parsed by composer/trace.go, keep both in sync.
+ */
+void fst_trace_dump(void) {
+	u32 level;
+	_CPU_ISR_Disable(level);
+	u32 const count = traceCount;
+	_CPU_ISR_Restore(level);
+
+	u32 const first = count > FST_TRACE_SIZE ? count - FST_TRACE_SIZE : 0;
+	printf("ORCA-TRACE 1 %u\n", first);
+	for (u32 i = first; i < count; i++) {
+		struct FSTTraceRecord const* const r = &trace[i % FST_TRACE_SIZE];
+		printf("R %u %u %u %u %u %d %llu %llu %llu\n", r->entry, r->offset, r->length, r->discOffset, r->transfer,
+		       r->result, ticks_to_microsecs(r->issued), ticks_to_microsecs(r->started),
+		       ticks_to_microsecs(r->completed));
+	}
+	printf("ORCA-TRACE-END\n");
+}
+#endif
+
 bool fst_isdir(struct FSTEntry* entry) {
 	return entry->ident & 0xFF000000;
 }
@@ -64,12 +157,12 @@ static struct FSTEntry* find_child(struct FSTEntry* dir, char const* name, size_
 	return NULL;
 }
 
-struct FSTEntry* fst_resolve_path(char* path) {
+static struct FSTEntry* walk_path(char const* path) {
 	struct FSTEntry* result = NULL;
 
 	struct FSTEntry* pwd = *FSTBase;
 	char const*      segment = path;
-	for (char* c = path;; c++) {
+	for (char const* c = path;; c++) {
 		if ((*c == '/') || (*c == '\\')) {
 			if (c == path) { /* first character */
 				segment++;
@@ -90,34 +183,231 @@ struct FSTEntry* fst_resolve_path(char* path) {
 	return result;
 }
 
-static void done_read_file(s32 bytes_read, dvdcmdblk* block) {
-	struct ExtDVDUD* extud = (struct ExtDVDUD*)DVD_GetUserData(block);
-	if (extud->cb != NULL) extud->cb(bytes_read, extud->ud);
-	free(extud);
-	free(block);
+/*
+ * Every file and directory is also indexed by a hash of its full path, so resolving a path doesn't depend on how many
+ * files are on the disc. Paths are hashed with FNV-1a as the walker above would split them, with '\\' read as '/'.
+ * Slots are open addressed with linear probing; paths whose hashes collide are marked and resolved with the walker.
+ * A path that isn't on the disc can still share a hash with one that is, so a hit is checked against the names of the
+ * entry and the directories above it before it is returned.
+ */
+#define PATH_HASH_BASIS 2166136261u
+#define PATH_HASH_PRIME 16777619u
+#define PATH_EMPTY      0          // Entry 0 is the root, which is never indexed
+#define PATH_AMBIGUOUS  UINT32_MAX // More than one path has this hash
+#define PATH_MAX_DEPTH  32
+
+struct FSTPathSlot {
+	u32 hash;
+	u32 entry;  // Index into the FST
+	u32 parent; // Index of the enclosing directory, which files don't record
+};
+
+static struct FSTPathSlot* paths = NULL;
+static u32                 pathsMask = 0; // Slot count - 1
+
+static u32 hash_name(u32 hash, char const* name, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (u8)name[i]) * PATH_HASH_PRIME;
+	}
+	return hash;
 }
 
-int fst_read_async(struct FSTEntry* entry, void* buffer, size_t length, off_t offset, fstreadcb cb, void* ud) {
+static u32 hash_separator(u32 hash) {
+	return (hash ^ '/') * PATH_HASH_PRIME;
+}
+
+static void index_path(u32 hash, u32 entry, u32 parent) {
+	for (u32 i = hash & pathsMask;; i = (i + 1) & pathsMask) {
+		if (paths[i].entry == PATH_EMPTY) {
+			paths[i] = (struct FSTPathSlot){.hash = hash, .entry = entry, .parent = parent};
+			return;
+		}
+		if (paths[i].hash == hash) {
+			paths[i].entry = PATH_AMBIGUOUS;
+			return;
+		}
+	}
+}
+
+static void build_path_index(void) {
+	u32 const numEntries = (*FSTBase)->length;
+	u32       numSlots = 1;
+	while (numSlots < numEntries * 2) {
+		numSlots <<= 1;
+	}
+	paths = aligned_alloc(32, ROUNDUP32(numSlots * sizeof(struct FSTPathSlot)));
+	mem_checkOOM(paths);
+	memset(paths, 0, numSlots * sizeof(struct FSTPathSlot));
+	pathsMask = numSlots - 1;
+
+	/* Directories enclosing the current entry, with the hash of their path */
+	u32 dirEnds[PATH_MAX_DEPTH + 1] = {numEntries};
+	u32 dirHashes[PATH_MAX_DEPTH + 1] = {PATH_HASH_BASIS};
+	u32 dirEntries[PATH_MAX_DEPTH + 1] = {0};
+	u32 depth = 0;
+	for (u32 i = 1; i < numEntries; i++) {
+		while (i >= dirEnds[depth]) {
+			depth--;
+		}
+		struct FSTEntry* const entry = *FSTBase + i;
+		char const* const      name = fst_get_filename(entry);
+		u32 const              hash = hash_name(depth == 0 ? PATH_HASH_BASIS : hash_separator(dirHashes[depth]), name,
+		                                        strlen(name));
+		index_path(hash, i, dirEntries[depth]);
+		if (fst_isdir(entry)) {
+			if (depth == PATH_MAX_DEPTH) {
+				printf("ERROR: Directory \"%s\" exceeds the maximum depth of %u\n", name, PATH_MAX_DEPTH);
+				exit(1);
+			}
+			depth++;
+			dirEnds[depth] = entry->length;
+			dirHashes[depth] = hash;
+			dirEntries[depth] = i;
+		}
+	}
+}
+
+/* Whether `path` (`len` characters, without a trailing separator) names `entry`, in directory `parent` */
+static bool path_names_entry(char const* path, size_t len, u32 entry, u32 parent) {
+	char const* end = path + len;
+	for (;;) {
+		char const* start = end;
+		while (start > path && start[-1] != '/' && start[-1] != '\\') {
+			start--;
+		}
+		char const* const name = fst_get_filename(*FSTBase + entry);
+		size_t const      nameLen = (size_t)(end - start);
+		if (strlen(name) != nameLen || memcmp(name, start, nameLen) != 0) return false;
+		if (start == path) return parent == 0;
+		if (parent == 0) return false;
+
+		end = start - 1;
+		entry = parent;
+		parent = (*FSTBase)[entry].offset; // parent_offset of a directory
+	}
+}
+
+static struct FSTEntry* lookup_path(char const* path) {
+	if (*path == '/' || *path == '\\') path++;
+	if (*path == '\0') return *FSTBase;
+
+	u32    hash = PATH_HASH_BASIS;
+	bool   trailingSeparator = false;
+	size_t segment = 0; // Length of the current segment
+	size_t len = 0;     // Length of the path without a trailing separator
+	for (char const* c = path; *c != '\0'; c++, len++) {
+		if (*c == '/' || *c == '\\') {
+			if (segment == 0) return NULL; // Empty segment
+			if (c[1] == '\0') {
+				trailingSeparator = true;
+				break;
+			}
+			hash = hash_separator(hash);
+			segment = 0;
+		} else {
+			hash = hash_name(hash, c, 1);
+			segment++;
+		}
+	}
+
+	for (u32 i = hash & pathsMask; paths[i].entry != PATH_EMPTY; i = (i + 1) & pathsMask) {
+		if (paths[i].hash != hash) continue;
+		if (paths[i].entry == PATH_AMBIGUOUS) return walk_path(path);
+		/* Every path on the disc with this hash would be marked ambiguous, so a different name means it isn't there */
+		if (!path_names_entry(path, len, paths[i].entry, paths[i].parent)) return NULL;
+		struct FSTEntry* const entry = *FSTBase + paths[i].entry;
+		if (trailingSeparator && !fst_isdir(entry)) return NULL;
+		return entry;
+	}
+	return NULL;
+}
+
+struct FSTEntry* fst_resolve_path(char* path) {
+	struct FSTEntry* const entry = lookup_path(path);
 #ifdef DEBUG
-	if (offset % 4 != 0) {
-		printf("DVD read offset must be multiple of 4\n");
+	if (entry != walk_path(path)) {
+		printf("ERROR: FST path index disagrees with the FST on \"%s\"\n", path);
 		exit(1);
 	}
 #endif
-	if (fst_isdir(entry)) return -1;
+	return entry;
+}
 
-	struct ExtDVDUD* extud = calloc(1, sizeof(struct ExtDVDUD));
-	extud->cb = cb;
-	extud->ud = (void*)ud;
+static void dispatch(void);
 
-	dvdcmdblk* block = calloc(1, sizeof(dvdcmdblk));
-	DVD_SetUserData(block, extud);
-	DVD_ReadAbsAsync(block, buffer, ROUNDUP32(length), entry->offset + offset, done_read_file);
+static void done_transfer(s32 result, [[maybe_unused]] dvdcmdblk* block) {
+	u64 const completed = gettime();
+	stats.transfers++;
+	busyMicroseconds += diff_usec(transfer.start, completed);
+	if (result >= 0 && transfer.bounced) DCInvalidateRange(bounce, transfer.length);
 
-	return 0;
+	if (result >= 0) {
+		for (struct FSTRequest* r = transfer.requests; r != NULL; r = r->next) {
+			stats.bytesRead += r->length;
+			if (!transfer.bounced) continue;
+			memcpy(r->buffer, bounce + (r->discOffset - transfer.discOffset), r->length);
+			DCFlushRange(r->buffer, r->length); // May be read by GX
+		}
+	}
+
+	/* The bounce buffer and request slots are free again, so callbacks may start new reads */
+	struct FSTRequest* request = transfer.requests;
+	transfer.requests = NULL;
+	while (request != NULL) {
+		struct FSTRequest* const next = request->next;
+		fstreadcb const          cb = request->cb;
+		void* const              ud = request->ud;
+		s32 const                bytesRead = result < 0 ? result : (s32)request->length;
+#ifdef FST_TRACE
+		trace_read(request, result, completed);
+#endif
+		request->next = freeRequests;
+		freeRequests = request;
+		stats.poolInUse--;
+		if (cb != NULL) cb(bytesRead, ud);
+		request = next;
+	}
+	LWP_ThreadBroadcast(poolQueue);
+	dispatch();
 }
 
-int fst_read_sync(struct FSTEntry* entry, void* buffer, size_t length, off_t offset) {
+/* Starts the next transfer if the drive is idle. Must be called with interrupts disabled */
+static void dispatch(void) {
+	if (transfer.requests != NULL || pending == NULL) return;
+
+	struct FSTRequest** first = &pending;
+	while (*first != NULL && (*first)->discOffset < head) {
+		first = &(*first)->next;
+	}
+	if (*first == NULL) first = &pending; // Nothing left ahead of the head, sweep again from the start
+
+	/* Take the run of requests close enough to the first to be read along with it */
+	struct FSTRequest* last = *first;
+	u32                end = last->discOffset + last->length;
+	while (last->next != NULL && last->next->discOffset <= end + FST_MERGE_GAP) {
+		u32 const nextEnd = last->next->discOffset + last->next->length;
+		if (nextEnd - (*first)->discOffset > FST_BOUNCE_SIZE) break;
+		last = last->next;
+		if (nextEnd > end) end = nextEnd;
+	}
+
+	transfer.requests = *first;
+	transfer.discOffset = (*first)->discOffset;
+	transfer.bounced = last != *first;
+	*first = last->next;
+	last->next = NULL;
+	for (struct FSTRequest* r = transfer.requests; r != NULL; r = r->next) {
+		stats.queueDepth--;
+	}
+
+	head = end;
+	transfer.length = ROUNDUP32(end - transfer.discOffset);
+	transfer.start = gettime();
+	DVD_ReadAbsAsync(&transfer.block, transfer.bounced ? bounce : transfer.requests->buffer, transfer.length,
+	                 transfer.discOffset, done_transfer);
+}
+
+int fst_read_async(struct FSTEntry* entry, void* buffer, size_t length, off_t offset, fstreadcb cb, void* ud) {
 #ifdef DEBUG
 	if (offset % 4 != 0) {
 		printf("DVD read offset must be multiple of 4\n");
@@ -126,12 +416,86 @@ int fst_read_sync(struct FSTEntry* entry, void* buffer, size_t length, off_t off
 #endif
 	if (fst_isdir(entry)) return -1;
 
-	dvdcmdblk block;
-	DVD_ReadAbs(&block, buffer, ROUNDUP32(length), entry->offset + offset);
+	u32 level;
+	_CPU_ISR_Disable(level);
+	struct FSTRequest* const request = freeRequests;
+	if (request == NULL) {
+		stats.poolExhausted++;
+		_CPU_ISR_Restore(level);
+		return FST_BUSY;
+	}
+	freeRequests = request->next;
+	stats.poolInUse++;
+	if (stats.poolInUse > stats.poolPeak) stats.poolPeak = stats.poolInUse;
+
+	request->buffer = buffer;
+	request->length = ROUNDUP32(length);
+	request->discOffset = entry->offset + offset;
+	request->cb = cb;
+	request->ud = ud;
+#ifdef FST_TRACE
+	request->entry = entry - *FSTBase;
+	request->offset = offset;
+	request->issued = gettime();
+#endif
+	struct FSTRequest** at = &pending;
+	while (*at != NULL && (*at)->discOffset <= request->discOffset) {
+		at = &(*at)->next;
+	}
+	request->next = *at;
+	*at = request;
+	stats.requests++;
+	stats.queueDepth++;
+	if (stats.queueDepth > stats.maxQueueDepth) stats.maxQueueDepth = stats.queueDepth;
+	dispatch();
+	_CPU_ISR_Restore(level);
 
 	return 0;
 }
 
+struct SyncRead {
+	lwpq_t        queue;
+	volatile bool done;
+};
+
+static void done_read_sync([[maybe_unused]] s32 bytes_read, void* ud) {
+	struct SyncRead* const read = ud;
+	read->done = true;
+	LWP_ThreadSignal(read->queue);
+}
+
+int fst_read_sync(struct FSTEntry* entry, void* buffer, size_t length, off_t offset) {
+	struct SyncRead read = {.done = false};
+	LWP_InitQueue(&read.queue);
+
+	u32 level;
+	_CPU_ISR_Disable(level);
+	int result;
+	while ((result = fst_read_async(entry, buffer, length, offset, done_read_sync, &read)) == FST_BUSY) {
+		LWP_ThreadSleep(poolQueue);
+	}
+	if (result != 0) {
+		_CPU_ISR_Restore(level);
+		LWP_CloseQueue(read.queue);
+		return result;
+	}
+	while (!read.done) {
+		LWP_ThreadSleep(read.queue);
+	}
+	_CPU_ISR_Restore(level);
+	LWP_CloseQueue(read.queue);
+
+	return 0;
+}
+
+struct FSTStats const* fst_get_stats(void) {
+	u32 level;
+	_CPU_ISR_Disable(level);
+	stats.bytesPerSecond = busyMicroseconds == 0 ? 0 : (u32)(stats.bytesRead * 1000000 / busyMicroseconds);
+	_CPU_ISR_Restore(level);
+	return &stats;
+}
+
 static void check_fst(void) {
 	for (struct FSTEntry* entry = *FSTBase; entry < *FSTBase + (*FSTBase)->length; entry++) {
 		if (entry->offset % 4 != 0) {
@@ -158,12 +522,25 @@ static void check_fst(void) {
 	}
 }
 
-void fst_init(void) {
+void fst_init(size_t maxReads) {
+	pool = aligned_alloc(32, ROUNDUP32(maxReads * sizeof(struct FSTRequest)));
+	if (pool == NULL) {
+		printf("ERROR: Could not allocate %u DVD read slots\n", (u32)maxReads);
+		exit(1);
+	}
+	for (size_t i = 0; i < maxReads; i++) {
+		pool[i].next = i + 1 < maxReads ? &pool[i + 1] : NULL;
+	}
+	freeRequests = maxReads == 0 ? NULL : pool;
+	stats.poolCapacity = maxReads;
+	LWP_InitQueue(&poolQueue);
+
 	DVD_Init();
 	DVD_Mount();
 #ifdef DEBUG
 	check_fst();
 #endif
+	build_path_index();
 #ifdef DEBUG_FST
 	print_fst();
 #endif
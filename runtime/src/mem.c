@@ -23,11 +23,19 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "mem.h"
 #include "render.h"
 
-void*         g_XFB0;
-void*         g_FIFO;
-static void*  scratchLow;  // Address where scratch memory area starts
-static void*  scratchNext; // Next free address in scratch memory
-static size_t scratchCapacity;
+#define FRAME_ARENA_SIZE 0x10000 // 64KiB
+
+struct Arena {
+	char const* name;
+	void*       low;  // Address where the arena starts
+	void*       next; // Next free address in the arena
+	size_t      capacity;
+};
+
+void*               g_XFB0;
+void*               g_FIFO;
+static struct Arena scratch = {.name = "scratch"}; // Level data, reset when a level is loaded
+static struct Arena frame = {.name = "frame"};     // Per-frame render data, reset every frame
 
 void mem_checkOOM(void* p) {
 	if (p == NULL) {
@@ -45,23 +53,39 @@ void mem_checkalign(void* p, size_t alignment, char const* info) {
 	}
 }
 
-void* mem_alloc_scratch(size_t n, size_t align) {
-	uint8_t* addr = scratchNext;
+static void* arena_alloc(struct Arena* arena, size_t n, size_t align) {
+	uint8_t* addr = arena->next;
 	if (align != 0 && n != 0 && (uintptr_t)addr % align != 0) {
-		addr += align - (uintptr_t)scratchNext % align;
+		addr += align - (uintptr_t)arena->next % align;
 	}
 
-	scratchNext = addr + n;
-	if ((uintptr_t)scratchNext > (uintptr_t)scratchLow + scratchCapacity) {
-		printf("ERROR: Ran out of scratch memory\n");
+	arena->next = addr + n;
+	if ((uintptr_t)arena->next > (uintptr_t)arena->low + arena->capacity) {
+		printf("ERROR: Ran out of %s memory\n", arena->name);
 		exit(1);
 	}
 
 	return addr;
 }
 
+void* mem_alloc_scratch(size_t n, size_t align) {
+	return arena_alloc(&scratch, n, align);
+}
+
+size_t mem_get_scratch_free(void) {
+	return (uintptr_t)scratch.low + scratch.capacity - (uintptr_t)scratch.next;
+}
+
 void mem_reset_scratch(void) {
-	scratchNext = scratchLow;
+	scratch.next = scratch.low;
+}
+
+void* mem_alloc_frame(size_t n, size_t align) {
+	return arena_alloc(&frame, n, align);
+}
+
+void mem_reset_frame(void) {
+	frame.next = frame.low;
 }
 
 void mem_init(size_t heapSize) {
@@ -71,9 +95,12 @@ void mem_init(size_t heapSize) {
 
 	g_XFB0 = SYS_AllocArenaMemHi(render_get_xfbsz(), 32);
 	g_FIFO = SYS_AllocArenaMemHi(render_get_fifosz(), 32);
+	frame.low = SYS_AllocArenaMemHi(FRAME_ARENA_SIZE, 32);
+	frame.next = frame.low;
+	frame.capacity = FRAME_ARENA_SIZE;
 
 	void* const scratchHigh = SYS_GetArenaHi();
-	scratchLow = SYS_AllocArenaMemHi((uintptr_t)SYS_GetArenaHi() - (uintptr_t)SYS_GetArenaLo() - heapSize, 32);
-	scratchNext = scratchLow;
-	scratchCapacity = (uintptr_t)scratchHigh - (uintptr_t)scratchLow;
+	scratch.low = SYS_AllocArenaMemHi((uintptr_t)SYS_GetArenaHi() - (uintptr_t)SYS_GetArenaLo() - heapSize, 32);
+	scratch.next = scratch.low;
+	scratch.capacity = (uintptr_t)scratchHigh - (uintptr_t)scratch.low;
 }
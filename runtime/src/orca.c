@@ -33,7 +33,7 @@ static struct Node* first_node_name(struct Model* m, char* name) {
 }
 
 int main(void) {
-#ifdef DEBUG
+#if defined(DEBUG) || defined(FST_TRACE)
 	CON_EnableBarnacle(EXI_CHANNEL_0, EXI_DEVICE_1);
 	CON_EnableGecko(EXI_CHANNEL_1, true);
 #endif
@@ -42,13 +42,28 @@ int main(void) {
 
 	mem_init(0x100000); // 1MB
 	render_init();
-	fst_init();
+	fst_init(64); // Reads that can be waiting on the drive at once
 
-	struct Level* const level = pak_load("~default");
-	if (level == NULL) {
+	struct PAKLoader* const loader = pak_load_async("~default");
+	if (loader == NULL) {
 		printf("ERROR: Could not locate default level (~default.PAK)\n");
 		exit(1);
 	}
+	render_ready();
+	while (!pak_poll(loader)) {
+		render_loading(pak_get_progress(loader));
+	}
+	struct Level* const level = pak_finish(loader);
+#ifdef DEBUG
+	struct FSTStats const* const io = fst_get_stats();
+	printf("Loaded %llu bytes in %u reads (%u transfers, max queue depth %u) at %u bytes/s\n", io->bytesRead,
+	       io->requests, io->transfers, io->maxQueueDepth, io->bytesPerSecond);
+	printf("Read slots: peak %u of %u, %u reads deferred\n", io->poolPeak, io->poolCapacity, io->poolExhausted);
+#endif
+#ifdef FST_TRACE
+	fst_trace_dump();
+#endif
+
 	struct Model* model = NULL;
 	for (struct Asset* a = level->assets; a < level->assets + level->numAssets; a++) {
 		if (a->type == ASSET_MODEL && strcmp(a->name, "~default") == 0) {
@@ -56,6 +71,9 @@ int main(void) {
 			break;
 		}
 	}
+	for (struct Asset* a = level->assets; a < level->assets + level->numAssets; a++) {
+		if (a->type == ASSET_MODEL) render_prepare_model(a->addr);
+	}
 
 	if (model != NULL) {
 		struct Node* const camera = first_node_name(model, "Camera");
@@ -67,7 +85,6 @@ int main(void) {
 		}
 	}
 
-	render_ready();
 	while (1) {
 		render_tick(model);
 	}
@@ -18,428 +18,401 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdlib.h>
 #include <stdalign.h>
+#include <math.h>
+#include <stddef.h>
 #include <string.h>
 #include "orca.h"
 #include "fst.h"
 #include "mem.h"
 #include "pak.h"
+#include "yaz0.h"
 
-struct PAKAccessor {
-	uint32_t name; // index into string table
-	uint32_t buffer_offset;
-	uint32_t count;
-	uint8_t  component_type;
-	uint8_t  element_type;
-	uint8_t  _pad[2];
-} __attribute__((__packed__));
-
-struct PAKMaterial {
-	uint32_t name; // index into string table
-	uint32_t baseColorTexture_offset;
-	uint32_t baseColorTexture_length;
-	uint16_t width;
-	uint16_t height;
-	uint8_t  tex_coord;
-	uint8_t  format;
-	uint8_t  wrapS;
-	uint8_t  wrapT;
-} __attribute__((__packed__));
-
-struct PAKMeshPrimitive {
-	/* indices into accessors table */
-	uint32_t attr_pos;
-	uint32_t attr_normal;
-	uint32_t attr_tangent;
-	uint32_t attr_st_0;
-	uint32_t attr_st_1;
-	uint32_t attr_vc_0;
-	uint32_t attr_joints_0;
-	uint32_t attr_weights_0;
-	uint32_t indices;
-	/* end indices into accessors table */
-	uint32_t material;
-	uint8_t  mode;
-	uint8_t  _pad[3];
-} __attribute__((__packed__));
-
-struct PAKMesh {
-	uint32_t name; // index into string table
-	uint32_t primitives_count;
-	uint32_t primitives; // index into index table
-} __attribute__((__packed__));
-
-struct PAKNode {
-	uint32_t name;        // index into string table
-	float    rotation[4]; // quaternion rotation (x,y,z,w)
-	float    scale[3];
-	float    translation[3];
-	uint32_t children_count;
-	uint32_t children; // index into index table
-	uint32_t mesh;     // index into mesh table
-} __attribute__((__packed__));
-
-struct PAKScene {
-	uint32_t name; // index into string table
-	uint32_t nodes_count;
-	uint32_t nodes; // index into index table
-} __attribute__((__packed__));
-
-struct PAKModel {
-	uint32_t index_table_count;
-	uint32_t index_table_offset;
-	uint32_t node_table_count;
-	uint32_t node_table_offset;
-	uint32_t mesh_table_count;
-	uint32_t mesh_table_offset;
-	uint32_t material_table_count;
-	uint32_t material_table_offset;
-	uint32_t primitive_table_count;
-	uint32_t primitive_table_offset;
-	uint32_t accessor_table_count;
-	uint32_t accessor_table_offset;
-	uint32_t scene_table_count;
-	uint32_t scene_table_offset;
-} __attribute__((__packed__));
+#define PAK_VERSION_MIN 11 // Oldest PAK version that can still be loaded
+#define PAK_VERSION     11
 
 struct PAKDirectoryEntry {
 	uint32_t name; // index into string table
 	uint32_t offset;
 	uint8_t  type;
 	uint8_t  _pad[3];
+	uint32_t length; // of the model's tables, starting at offset
 } __attribute__((__packed__));
 
 struct PAKHeader {
-	char     signature[4];
+	char     signature[2];
+	uint16_t version;
 	uint32_t string_table_length;
 	uint32_t string_table_offset;
 	uint32_t directory_count;
 	uint32_t directory_offset;
+	uint32_t scratch_size; // Scratch the level allocates when loaded from a whole image, besides the image and assets
 } __attribute__((__packed__));
 
+/* Sizes as laid out by the composer, see composer/pak.go */
+_Static_assert(sizeof(struct Model) == 84, "must match the composer");
+_Static_assert(sizeof(struct Node) == 244, "must match the composer");
+_Static_assert(offsetof(struct Node, dirty) == 76, "must match the composer");
+_Static_assert(sizeof(struct Mesh) == 12, "must match the composer");
+_Static_assert(sizeof(struct Material) == 40, "must match the composer");
+_Static_assert(sizeof(GXTexObj) == 32, "must match GX_TEXOBJ_SIZE in the composer");
+_Static_assert(sizeof(struct MeshPrimitive) == 80, "must match the composer");
+_Static_assert(sizeof(struct Accessor) == 36, "must match the composer");
+_Static_assert(sizeof(struct Scene) == 12, "must match the composer");
+_Static_assert(sizeof(struct BVHItem) == 8, "must match the composer");
+
 /*
-46:17:698 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: loading...
-46:17:745 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_asset
-46:17:746 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_model
-46:17:746 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_node
-46:17:747 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_node
-46:17:747 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_node
-46:17:748 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_mesh
-46:17:748 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_material
-46:17:971 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_primitive
-46:18:027 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_accessor
-46:18:110 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_accessor
-46:18:126 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_accessor
-46:18:128 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_accessor
-46:18:190 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: init_scene
-46:18:190 Core\HW\EXI\EXI_DeviceIPL.cpp:307 N[OSREPORT]: done loading
-*/
+ * A level is loaded as a queue of reads, all of which are handed to the drive as soon as they are known. Each read may
+ * have a decoder, which pak_poll() runs on the main thread once the read has completed. Reads are decoded strictly in
+ * the order they were queued, so a decoder can rely on the data of every read queued before its own (such as the
+ * string table before the directory), and the drive keeps working on the reads queued after it while it runs. Reads
+ * the drive has no room for yet (FST_BUSY) are handed to it from pak_poll() as earlier ones complete.
+ *
+ * The header is read first. If the whole file fits in scratch along with what the level allocates there as it loads,
+ * the file is then read with a single request, and the level is decoded where it lies in that image: the queue then
+ * only holds decoders, which are ready at once.
+ */
+typedef void (*pakdecodefn)(struct PAKLoader* loader, void* buffer, void* ud);
+
+struct PAKRead {
+	struct PAKRead* next;
+	void*           buffer;
+	size_t          length;
+	uint32_t        offset;
+	pakdecodefn     decode; // NULL if the data is used as-is
+	void*           ud;
+	volatile bool   done; // Set from the DVD callback
+	s32             result;
+};
+
+struct PAKLoader {
+	char             filename[63 + 4 + 1];
+	struct FSTEntry* file;
+	struct Level*    level;
+	struct PAKRead*  head; // Oldest read that hasn't been decoded yet
+	struct PAKRead*  tail;
+	struct PAKRead*  unissued; // Oldest read that hasn't been handed to the drive yet
+	uint8_t*         image;    // The whole file if it was read at once, NULL if it is read piece by piece
+	size_t           bytesLoaded;
+};
+
+static void read_done(s32 bytesRead, void* ud) {
+	struct PAKRead* const read = ud;
+	read->result = bytesRead;
+	read->done = true;
+}
 
-static void init_node(struct Level* level, struct Model* model, struct Node* node, struct PAKNode* PAKNode) {
-	node->name = PAKNode->name == UINT32_MAX ? "" : level->stringTable + PAKNode->name;
-	node->mesh = PAKNode->mesh == UINT32_MAX ? NULL : model->meshes + PAKNode->mesh;
-	node->childrenIdxs = model->idxs + PAKNode->children;
-	node->numChildren = PAKNode->children_count;
-	node->rotation.x = PAKNode->rotation[0];
-	node->rotation.y = PAKNode->rotation[1];
-	node->rotation.z = PAKNode->rotation[2];
-	node->rotation.w = PAKNode->rotation[3];
-	node->scale.x = PAKNode->scale[0];
-	node->scale.y = PAKNode->scale[1];
-	node->scale.z = PAKNode->scale[2];
-	node->translation.x = PAKNode->translation[0];
-	node->translation.y = PAKNode->translation[1];
-	node->translation.z = PAKNode->translation[2];
+/* Hands queued reads to the drive in order until it has no room for more */
+static void issue_reads(struct PAKLoader* loader) {
+	while (loader->unissued != NULL) {
+		struct PAKRead* const read = loader->unissued;
+		if (read->length == 0) {
+			read->done = true; // Nothing to wait for, but the decoder still has to run in order
+		} else if (fst_read_async(loader->file, read->buffer, read->length, read->offset, read_done, read) ==
+		           FST_BUSY) {
+			return;
+		}
+		loader->unissued = read->next;
+	}
 }
 
-static void init_mesh(struct Level* level, struct Model* model, struct Mesh* mesh, struct PAKMesh* PAKMesh) {
-	mesh->name = PAKMesh->name == UINT32_MAX ? NULL : level->stringTable + PAKMesh->name;
-	mesh->primitivesIdxs = model->idxs + PAKMesh->primitives;
-	mesh->numPrimitives = PAKMesh->primitives_count;
+static void queue_read(struct PAKLoader* loader, void* buffer, size_t length, uint32_t offset, pakdecodefn decode,
+                       void* ud) {
+	if (length == 0 && decode == NULL) return;
+
+	struct PAKRead* const read = malloc(sizeof(struct PAKRead));
+	mem_checkOOM(read);
+	*read = (struct PAKRead){
+	    .next = NULL,
+	    .buffer = buffer,
+	    .length = ROUNDUP32(length),
+	    .offset = offset,
+	    .decode = decode,
+	    .ud = ud,
+	    .done = false,
+	    .result = 0,
+	};
+	if (loader->tail == NULL) {
+		loader->head = read;
+	} else {
+		loader->tail->next = read;
+	}
+	loader->tail = read;
+	if (loader->unissued == NULL) loader->unissued = read;
+	issue_reads(loader);
 }
 
-static inline enum WrapMode get_wrap_mode(uint8_t mode) {
-	switch (mode) {
-	case 0:
-		return WRAP_CLAMP;
-		break;
-	case 1:
-		return WRAP_MIRROR;
-		break;
-	case 2:
-		return WRAP_REPEAT;
-		break;
-	default:
-		printf("WARNING: Unrecognized wrap mode '%u', defaulting to WRAP_CLAMP.\n", mode);
-		return WRAP_CLAMP;
-		break;
+/* Data kept for the level, which is available once `decode` runs */
+static void* load_data(struct PAKLoader* loader, size_t length, uint32_t offset, pakdecodefn decode, void* ud) {
+	if (loader->image != NULL) {
+		void* const data = loader->image + offset;
+		queue_read(loader, data, 0, offset, decode, ud);
+		return data;
 	}
+	void* const data = mem_alloc_scratch(ROUNDUP32(length), 32);
+	queue_read(loader, data, length, offset, decode, ud);
+	return data;
 }
 
-static void init_material(struct FSTEntry* file, struct Level* level, struct Material* material,
-                          struct PAKMaterial* PAKMaterial) {
-	material->name = PAKMaterial->name == UINT32_MAX ? "" : level->stringTable + PAKMaterial->name;
-	material->texture = mem_alloc_scratch(sizeof(GXTexObj), 32);
-	material->wrapS = get_wrap_mode(PAKMaterial->wrapS);
-	material->wrapT = get_wrap_mode(PAKMaterial->wrapT);
-	switch (PAKMaterial->format) {
-	case 0:
-		material->format = TF_I4;
-		break;
-	case 1:
-		material->format = TF_I8;
-		break;
-	case 2:
-		material->format = TF_IA4;
-		break;
-	case 3:
-		material->format = TF_IA8;
-		break;
-	case 7:
-		material->format = TF_RGB565;
-		break;
-	case 8:
-		material->format = TF_RGB5A3;
-		break;
-	case 9:
-		material->format = TF_RGBA8;
-		break;
-	case 10:
-		material->format = TF_CMPR;
-		break;
-	default:
-		printf("ERROR: Unrecognized texture format '%u'\n", PAKMaterial->format);
+static void decode_yaz0([[maybe_unused]] struct PAKLoader* loader, void* buffer, void* ud) {
+	size_t const size = yaz0_get_size(buffer);
+	yaz0_decode(buffer, ud);
+	DCFlushRange(ud, ROUNDUP32(size)); // May be read by GX
+}
+
+/*
+ * Allocates the destination of bulk data in scratch and queues its read. Compressed data is read into the end of the
+ * destination and decompressed in place by pak_poll(), while the drive moves on to the next read.
+ */
+static void* queue_blob(struct PAKLoader* loader, size_t size, uint32_t compressedSize, uint32_t offset) {
+	if (compressedSize == 0) return load_data(loader, size, offset, NULL, NULL);
+	if (loader->image != NULL) {
+		void* const buffer = mem_alloc_scratch(ROUNDUP32(size), 32);
+		queue_read(loader, loader->image + offset, 0, offset, decode_yaz0, buffer);
+		return buffer;
+	}
+
+	size_t const   bufsz = ROUNDUP32(size) + YAZ0_SLACK;
+	uint8_t* const buffer = mem_alloc_scratch(bufsz, 32);
+	uint8_t* const stream = buffer + bufsz - ROUNDUP32(compressedSize);
+	if (stream < buffer) {
+		printf("ERROR: Compressed data is larger than its destination\n");
 		exit(1);
 	}
-	material->texCoord = PAKMaterial->tex_coord;
+	DCInvalidateRange(stream, ROUNDUP32(compressedSize)); // Read back by the CPU
+	queue_read(loader, stream, compressedSize, offset, decode_yaz0, buffer);
+	return buffer;
+}
+
+/* Buffer for a table that is decoded and then freed. Must be freed by the caller */
+static void* alloc_table(size_t n) {
+	void* const table = aligned_alloc(32, n == 0 ? 32 : ROUNDUP32(n));
+	mem_checkOOM(table);
+	return table;
+}
+
+/* Data that is only needed by `decode`, which must release it with free_table() */
+static void load_table(struct PAKLoader* loader, size_t length, uint32_t offset, pakdecodefn decode) {
+	if (loader->image != NULL) {
+		queue_read(loader, loader->image + offset, 0, offset, decode, NULL);
+	} else {
+		queue_read(loader, alloc_table(length), length, offset, decode, NULL);
+	}
+}
 
-	size_t const texbufsz = ROUNDUP32(PAKMaterial->baseColorTexture_length);
-	void*        texture = mem_alloc_scratch(texbufsz, 32);
-	fst_read_sync(file, texture, texbufsz, PAKMaterial->baseColorTexture_offset);
+static void free_table(struct PAKLoader* loader, void* table) {
+	if (loader->image == NULL) free(table);
+}
 
-	GX_InitTexObj(material->texture, texture, PAKMaterial->width, PAKMaterial->height, material->format,
-	              material->wrapS, material->wrapT, FALSE);
+/* Turns an offset from `base` stored in a pointer field into a pointer */
+#define RELOCATE(field, base) ((field) = (void*)((uint8_t*)(base) + (uintptr_t)(field)))
+/* Turns a table index stored in a pointer field into a pointer to that element of `table`, UINT32_MAX into NULL */
+#define RELOCATE_INDEX(field, table) ((field) = (uintptr_t)(field) == UINT32_MAX ? NULL : (table) + (uintptr_t)(field))
+/* Turns a string table offset stored in a pointer field into a string, UINT32_MAX into `fallback` */
+#define RELOCATE_STRING(field, level, fallback)                                                                        \
+	((field) = (uintptr_t)(field) == UINT32_MAX ? (fallback) : (level)->stringTable + (uintptr_t)(field))
+
+static void fixup_node(struct Level* level, struct Model* model, struct Node* node) {
+	RELOCATE_STRING(node->name, level, "");
+	RELOCATE_INDEX(node->mesh, model->meshes);
+	RELOCATE_INDEX(node->parent, model->nodes);
+	RELOCATE_INDEX(node->childrenIdxs, model->idxs);
+	node->dirty = true;
 }
 
-static void init_primitive(struct Model* model, struct MeshPrimitive* primitive,
-                           struct PAKMeshPrimitive* PAKMeshPrimitive) {
-	primitive->attrPos =
-	    PAKMeshPrimitive->attr_pos == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_pos;
-	primitive->attrNormal =
-	    PAKMeshPrimitive->attr_normal == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_normal;
-	primitive->attrTangent =
-	    PAKMeshPrimitive->attr_tangent == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_tangent;
-	primitive->attrTexCoord0 =
-	    PAKMeshPrimitive->attr_st_0 == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_st_0;
-	primitive->attrTexCoord1 =
-	    PAKMeshPrimitive->attr_st_1 == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_st_1;
-	primitive->attrColor =
-	    PAKMeshPrimitive->attr_vc_0 == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_vc_0;
-	primitive->attrJoints =
-	    PAKMeshPrimitive->attr_joints_0 == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_joints_0;
-	primitive->attrWeights =
-	    PAKMeshPrimitive->attr_weights_0 == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->attr_weights_0;
-	primitive->indices = PAKMeshPrimitive->indices == UINT32_MAX ? NULL : model->accessors + PAKMeshPrimitive->indices;
-	primitive->material =
-	    PAKMeshPrimitive->material == UINT32_MAX ? NULL : model->materials + PAKMeshPrimitive->material;
-
-	switch (PAKMeshPrimitive->mode) {
-	case 0:
-		primitive->mode = MODE_POINTS;
-		break;
-	case 1:
-		primitive->mode = MODE_LINES;
-		break;
-	case 3:
-		primitive->mode = MODE_LINE_STRIP;
-		break;
-	case 4:
-		primitive->mode = MODE_TRIANGLES;
-		break;
-	case 5:
-		primitive->mode = MODE_TRIANGLE_STRIP;
-		break;
-	case 6:
-		primitive->mode = MODE_TRIANGLE_FAN;
+static void fixup_mesh(struct Level* level, struct Model* model, struct Mesh* mesh) {
+	RELOCATE_STRING(mesh->name, level, NULL);
+	RELOCATE_INDEX(mesh->primitivesIdxs, model->idxs);
+}
+
+/* `shared` is the buffer of an earlier material with the same image, NULL if this is the first to use it */
+static void fixup_material(struct PAKLoader* loader, struct Level* level, struct Material* material, void* shared) {
+	RELOCATE_STRING(material->name, level, "");
+	switch (material->format) {
+	case TF_I4:
+	case TF_I8:
+	case TF_IA4:
+	case TF_IA8:
+	case TF_RGB565:
+	case TF_RGB5A3:
+	case TF_RGBA8:
+	case TF_CMPR:
 		break;
 	default:
-		printf("ERROR: Unrecognized primitive mode '%u'\n", PAKMeshPrimitive->mode);
+		printf("ERROR: Unrecognized texture format '%u'\n", material->format);
 		exit(1);
 	}
+
+	if (shared != NULL) {
+		material->image = shared;
+	} else {
+		material->image = queue_blob(loader, material->imageSize, material->compressedSize, (uintptr_t)material->image);
+	}
+
+	/* Only the texture's address is needed here, so the object can be set up before the texels arrive */
+	material->texture = mem_alloc_scratch(sizeof(GXTexObj), 32);
+	GX_InitTexObj(material->texture, material->image, material->width, material->height, material->format,
+	              material->wrapS, material->wrapT, FALSE);
 }
 
-static void init_accessor(struct FSTEntry* file, struct Level* level, struct Accessor* accessor,
-                          struct PAKAccessor* PAKAccessor) {
-	accessor->name = PAKAccessor->name == UINT32_MAX ? "" : level->stringTable + PAKAccessor->name;
+static void fixup_primitive(struct Model* model, struct MeshPrimitive* primitive) {
+	RELOCATE_INDEX(primitive->attrPos, model->accessors);
+	RELOCATE_INDEX(primitive->attrNormal, model->accessors);
+	RELOCATE_INDEX(primitive->attrTangent, model->accessors);
+	RELOCATE_INDEX(primitive->attrTexCoord0, model->accessors);
+	RELOCATE_INDEX(primitive->attrTexCoord1, model->accessors);
+	RELOCATE_INDEX(primitive->attrColor, model->accessors);
+	RELOCATE_INDEX(primitive->attrJoints, model->accessors);
+	RELOCATE_INDEX(primitive->attrWeights, model->accessors);
+	RELOCATE_INDEX(primitive->indices, model->accessors);
+	RELOCATE_INDEX(primitive->material, model->materials);
+	/* Lists that weren't baked are recorded by the renderer after loading */
+	RELOCATE_INDEX(primitive->displayList, (uint8_t*)model->displayLists);
+
+	/* The composer splits primitives into batches GX can draw with 16-bit indices */
+	if (primitive->indices != NULL && primitive->indices->componentType != COMPONENT_U16) {
+		printf("ERROR: Primitive indices must be u16\n");
+		exit(1);
+	}
+	size_t const count = primitive->indices != NULL ? primitive->indices->count
+	                     : primitive->attrPos != NULL ? primitive->attrPos->count
+	                                                  : 0;
+	if (count > UINT16_MAX) {
+		printf("ERROR: Primitive has more than %u vertices\n", UINT16_MAX);
+		exit(1);
+	}
 
-	size_t compSize = 0;
-	size_t compCount = 0;
-	switch (PAKAccessor->component_type) {
-	case 0:
-		accessor->componentType = COMPONENT_F32;
-		compSize = sizeof(float);
-		break;
-	case 1:
-		accessor->componentType = COMPONENT_S8;
-		compSize = sizeof(int8_t);
-		break;
-	case 2:
-		accessor->componentType = COMPONENT_U8;
-		compSize = sizeof(uint8_t);
-		break;
-	case 3:
-		accessor->componentType = COMPONENT_S16;
-		compSize = sizeof(int16_t);
-		break;
-	case 4:
-		accessor->componentType = COMPONENT_U16;
-		compSize = sizeof(uint16_t);
-		break;
-	case 5:
-		accessor->componentType = COMPONENT_U32;
-		compSize = sizeof(uint32_t);
+	switch (primitive->mode) {
+	case MODE_POINTS:
+	case MODE_LINES:
+	case MODE_LINE_STRIP:
+	case MODE_TRIANGLES:
+	case MODE_TRIANGLE_STRIP:
+	case MODE_TRIANGLE_FAN:
 		break;
 	default:
-		printf("ERROR: Unrecognized component type '%u'\n", PAKAccessor->component_type);
+		printf("ERROR: Unrecognized primitive mode '%u'\n", primitive->mode);
 		exit(1);
 	}
-	switch (PAKAccessor->element_type) {
-	case 0:
-		accessor->elementType = ELEM_SCALAR;
-		compCount = 1;
-		break;
-	case 1:
-		accessor->elementType = ELEM_VEC2;
-		compCount = 2;
-		break;
-	case 2:
-		accessor->elementType = ELEM_VEC3;
-		compCount = 3;
-		break;
-	case 3:
-		accessor->elementType = ELEM_VEC4;
-		compCount = 4;
-		break;
-	case 4:
-		accessor->elementType = ELEM_MAT2;
-		compCount = 4;
-		break;
-	case 5:
-		accessor->elementType = ELEM_MAT3;
-		compCount = 9;
-		break;
-	case 6:
-		accessor->elementType = ELEM_MAT4;
-		compCount = 16;
+}
+
+static void fixup_accessor(struct PAKLoader* loader, struct Level* level, struct Model* model,
+                           struct Accessor* accessor) {
+	RELOCATE_STRING(accessor->name, level, "");
+	RELOCATE_INDEX(accessor->interleavedWith, model->accessors);
+	switch (accessor->componentType) {
+	case COMPONENT_F32:
+	case COMPONENT_S8:
+	case COMPONENT_U8:
+	case COMPONENT_S16:
+	case COMPONENT_U16:
+	case COMPONENT_U32:
+		break;
+	case COMPONENT_COLOR:
+		if (accessor->colorFormat > GX_RGBA8) {
+			printf("ERROR: Unrecognized color format '%u'\n", accessor->colorFormat);
+			exit(1);
+		}
 		break;
 	default:
-		printf("ERROR: Unrecognized element type '%u'\n", PAKAccessor->element_type);
+		printf("ERROR: Unrecognized component type '%u'\n", accessor->componentType);
+		exit(1);
+	}
+	if (accessor->elementType > ELEM_MAT4) {
+		printf("ERROR: Unrecognized element type '%u'\n", accessor->elementType);
+		exit(1);
+	}
+	if (accessor->frac > 31) { // Width of the GX vertex format field
+		printf("ERROR: Accessor has %u fractional bits, at most 31 are supported\n", accessor->frac);
 		exit(1);
 	}
 
-	accessor->count = PAKAccessor->count;
-	accessor->stride = compSize * compCount;
-	size_t const bufsz = ROUNDUP32(accessor->stride * accessor->count);
-	accessor->buffer = mem_alloc_scratch(bufsz, 32);
-	fst_read_sync(file, accessor->buffer, bufsz, PAKAccessor->buffer_offset);
+	if (accessor->interleavedWith != NULL) return; // Points into the owner's buffer, see decode_model()
+	accessor->buffer = queue_blob(loader, accessor->stride * accessor->count, accessor->compressedSize,
+	                              (uintptr_t)accessor->buffer);
 }
 
-static void init_scene(struct Level* level, struct Model* model, struct Scene* scene, struct PAKScene* PAKScene) {
-	scene->name = PAKScene->name == UINT32_MAX ? "" : level->stringTable + PAKScene->name;
-	scene->nodesIdxs = model->idxs + PAKScene->nodes;
-	scene->numNodes = PAKScene->nodes_count;
+static void fixup_scene(struct Level* level, struct Model* model, struct Scene* scene) {
+	RELOCATE_STRING(scene->name, level, "");
+	RELOCATE_INDEX(scene->nodesIdxs, model->idxs);
 }
 
-static void init_model(struct FSTEntry* file, struct Level* level, struct Model* model, struct PAKModel* PAKModel) {
-	model->numIdxs = PAKModel->index_table_count;
-	model->numNodes = PAKModel->node_table_count;
-	model->numMeshes = PAKModel->mesh_table_count;
-	model->numMaterials = PAKModel->material_table_count;
-	model->numPrimitives = PAKModel->primitive_table_count;
-	model->numAccessors = PAKModel->accessor_table_count;
-	model->numScenes = PAKModel->scene_table_count;
-
-	model->idxs = mem_alloc_scratch(model->numIdxs * sizeof(uint32_t), 32);
-	model->nodes = mem_alloc_scratch(model->numNodes * sizeof(struct Node), alignof(struct Node));
-	model->meshes = mem_alloc_scratch(model->numMeshes * sizeof(struct Mesh), alignof(struct Mesh));
-	model->materials = mem_alloc_scratch(model->numMaterials * sizeof(struct Material), alignof(struct Material));
-	model->primitives =
-	    mem_alloc_scratch(model->numPrimitives * sizeof(struct MeshPrimitive), alignof(struct MeshPrimitive));
-	model->accessors = mem_alloc_scratch(model->numAccessors * sizeof(struct Accessor), alignof(struct Accessor));
-	model->scenes = mem_alloc_scratch(model->numScenes * sizeof(struct Scene), alignof(struct Scene));
-
-	fst_read_sync(file, model->idxs, PAKModel->index_table_count * sizeof(uint32_t), PAKModel->index_table_offset);
-
-	struct PAKNode* const PAKNodes = aligned_alloc(32, ROUNDUP32(PAKModel->node_table_count * sizeof(struct PAKNode)));
-	mem_checkOOM(PAKNodes);
-	fst_read_sync(file, PAKNodes, ROUNDUP32(PAKModel->node_table_count * sizeof(struct PAKNode)),
-	              PAKModel->node_table_offset);
-	for (uint32_t i = 0; i < PAKModel->node_table_count; i++) {
-		init_node(level, model, &model->nodes[i], &PAKNodes[i]);
+/*
+ * A model's tables are stored in one block, headed by its struct Model, so they arrive with a single read and are
+ * fixed up where they landed. Only the bulk data they refer to (display lists, textures and vertex buffers) is read
+ * separately.
+ */
+static void decode_model(struct PAKLoader* loader, void* buffer, [[maybe_unused]] void* ud) {
+	struct Level* const level = loader->level;
+	struct Model* const model = buffer;
+
+	RELOCATE(model->idxs, model);
+	RELOCATE(model->nodes, model);
+	RELOCATE(model->meshes, model);
+	RELOCATE(model->materials, model);
+	RELOCATE(model->primitives, model);
+	RELOCATE(model->accessors, model);
+	RELOCATE(model->scenes, model);
+	if (model->numBVHNodes == 0) {
+		model->bvh = NULL;
+		model->bvhItems = NULL;
+	} else {
+		RELOCATE(model->bvh, model);
+		RELOCATE(model->bvhItems, model);
 	}
-	free(PAKNodes);
-
-	struct PAKMesh* const PAKMeshes = aligned_alloc(32, ROUNDUP32(PAKModel->mesh_table_count * sizeof(struct PAKMesh)));
-	mem_checkOOM(PAKMeshes);
-	fst_read_sync(file, PAKMeshes, ROUNDUP32(PAKModel->mesh_table_count * sizeof(struct PAKMesh)),
-	              PAKModel->mesh_table_offset);
-	for (uint32_t i = 0; i < PAKModel->mesh_table_count; i++) {
-		init_mesh(level, model, &model->meshes[i], &PAKMeshes[i]);
+	model->posed = false;
+
+	model->displayLists = load_data(loader, model->displayListsSize, (uintptr_t)model->displayLists, NULL, NULL);
+
+	for (struct Node* n = model->nodes; n < model->nodes + model->numNodes; n++) {
+		fixup_node(level, model, n);
 	}
-	free(PAKMeshes);
-
-	struct PAKMaterial* const PAKMaterials =
-	    aligned_alloc(32, ROUNDUP32(PAKModel->material_table_count * sizeof(struct PAKMaterial)));
-	mem_checkOOM(PAKMaterials);
-	fst_read_sync(file, PAKMaterials, ROUNDUP32(PAKModel->material_table_count * sizeof(struct PAKMaterial)),
-	              PAKModel->material_table_offset);
-	for (uint32_t i = 0; i < PAKModel->material_table_count; i++) {
-		init_material(file, level, &model->materials[i], &PAKMaterials[i]);
+	for (struct Mesh* m = model->meshes; m < model->meshes + model->numMeshes; m++) {
+		fixup_mesh(level, model, m);
 	}
-	free(PAKMaterials);
-
-	struct PAKMeshPrimitive* const PAKMeshPrimitives =
-	    aligned_alloc(32, ROUNDUP32(PAKModel->primitive_table_count * sizeof(struct PAKMeshPrimitive)));
-	mem_checkOOM(PAKMeshPrimitives);
-	fst_read_sync(file, PAKMeshPrimitives, ROUNDUP32(PAKModel->primitive_table_count * sizeof(struct PAKMeshPrimitive)),
-	              PAKModel->primitive_table_offset);
-	for (uint32_t i = 0; i < PAKModel->primitive_table_count; i++) {
-		init_primitive(model, &model->primitives[i], &PAKMeshPrimitives[i]);
+	/* The composer stores an image once however many materials use it, and they share one buffer for it too */
+	uint32_t* const imageOffsets = malloc(model->numMaterials * sizeof(uint32_t) + 1);
+	mem_checkOOM(imageOffsets);
+	for (size_t i = 0; i < model->numMaterials; i++) {
+		struct Material* const m = model->materials + i;
+		imageOffsets[i] = (uintptr_t)m->image;
+		size_t first = 0;
+		while (imageOffsets[first] != imageOffsets[i]) {
+			first++;
+		}
+		fixup_material(loader, level, m, first < i ? model->materials[first].image : NULL);
 	}
-	free(PAKMeshPrimitives);
-
-	struct PAKAccessor* const PAKAccessors =
-	    aligned_alloc(32, ROUNDUP32(PAKModel->accessor_table_count * sizeof(struct PAKAccessor)));
-	mem_checkOOM(PAKAccessors);
-	fst_read_sync(file, PAKAccessors, ROUNDUP32(PAKModel->accessor_table_count * sizeof(struct PAKAccessor)),
-	              PAKModel->accessor_table_offset);
-	for (uint32_t i = 0; i < PAKModel->accessor_table_count; i++) {
-		init_accessor(file, level, &model->accessors[i], &PAKAccessors[i]);
+	free(imageOffsets);
+	for (struct MeshPrimitive* p = model->primitives; p < model->primitives + model->numPrimitives; p++) {
+		fixup_primitive(model, p);
 	}
-	free(PAKAccessors);
-
-	struct PAKScene* const PAKScenes =
-	    aligned_alloc(32, ROUNDUP32(PAKModel->scene_table_count * sizeof(struct PAKScene)));
-	mem_checkOOM(PAKScenes);
-	fst_read_sync(file, PAKScenes, ROUNDUP32(PAKModel->scene_table_count * sizeof(struct PAKScene)),
-	              PAKModel->scene_table_offset);
-	for (uint32_t i = 0; i < PAKModel->scene_table_count; i++) {
-		init_scene(level, model, &model->scenes[i], &PAKScenes[i]);
+	for (struct Accessor* a = model->accessors; a < model->accessors + model->numAccessors; a++) {
+		fixup_accessor(loader, level, model, a);
+	}
+	/* An interleaved stream is read once, with the accessor that owns it, whose buffer is known once all are fixed */
+	for (struct Accessor* a = model->accessors; a < model->accessors + model->numAccessors; a++) {
+		struct Accessor* const owner = a->interleavedWith;
+		if (owner == NULL) continue;
+		if (owner->interleavedWith != NULL || owner->stride != a->stride || owner->count != a->count ||
+		    (uintptr_t)a->buffer >= a->stride) {
+			printf("ERROR: Accessor '%s' is interleaved with an incompatible accessor\n", a->name);
+			exit(1);
+		}
+		a->buffer = (uint8_t*)owner->buffer + (uintptr_t)a->buffer;
+	}
+	for (struct Scene* s = model->scenes; s < model->scenes + model->numScenes; s++) {
+		fixup_scene(level, model, s);
 	}
-	free(PAKScenes);
 }
 
-static void init_asset(struct FSTEntry* file, struct Level* level, struct Asset* asset,
+static void init_asset(struct PAKLoader* loader, struct Level* level, struct Asset* asset,
                        struct PAKDirectoryEntry* PAKDirectoryEntry) {
 	asset->name = PAKDirectoryEntry->name == UINT32_MAX ? "" : level->stringTable + PAKDirectoryEntry->name;
 	asset->type = PAKDirectoryEntry->type;
 
 	switch (asset->type) {
 	case ASSET_MODEL:
-		asset->addr = mem_alloc_scratch(sizeof(struct Model), alignof(struct Model));
-		struct PAKModel* PAKModel = aligned_alloc(32, ROUNDUP32(sizeof(struct PAKModel)));
-		fst_read_sync(file, PAKModel, ROUNDUP32(sizeof(struct PAKModel)), PAKDirectoryEntry->offset);
-		init_model(file, level, asset->addr, PAKModel);
-		free(PAKModel);
+		asset->addr = load_data(loader, PAKDirectoryEntry->length, PAKDirectoryEntry->offset, decode_model, NULL);
+		break;
 	case ASSET_SCRIPT:
 	case ASSET_SOUND:
 	default:
@@ -447,38 +420,123 @@ static void init_asset(struct FSTEntry* file, struct Level* level, struct Asset*
 	}
 }
 
-struct Level* pak_load(char* levelName) {
+static void decode_directory(struct PAKLoader* loader, void* buffer, [[maybe_unused]] void* ud) {
+	struct PAKDirectoryEntry* const directory = buffer;
+	for (size_t i = 0; i < loader->level->numAssets; i++) {
+		init_asset(loader, loader->level, &loader->level->assets[i], &directory[i]);
+	}
+	free_table(loader, directory);
+}
+
+static void decode_image(struct PAKLoader* loader, void* buffer, void* ud);
+
+/*
+ * Queues a read of the whole file if it fits in free scratch, along with the asset table and everything the composer
+ * recorded the level allocating as it loads: decompressed data, texture objects and the display lists the renderer
+ * records
+ */
+static bool queue_image(struct PAKLoader* loader, struct PAKHeader const* header) {
+	size_t const imageSize = ROUNDUP32(loader->file->length);
+	size_t const assetsSize = ROUNDUP32(sizeof(struct Asset) * header->directory_count);
+	if (imageSize + assetsSize + header->scratch_size > mem_get_scratch_free()) return false;
+
+	uint8_t* const image = mem_alloc_scratch(imageSize, 32);
+	DCInvalidateRange(image, imageSize); // The tables are read back by the CPU
+	queue_read(loader, image, loader->file->length, 0, decode_image, NULL);
+	return true;
+}
+
+static void decode_header(struct PAKLoader* loader, void* buffer, [[maybe_unused]] void* ud) {
+	struct PAKHeader* const header = buffer;
+	struct Level* const     level = loader->level;
+	if (memcmp(header->signature, "O2", 2) != 0) {
+		printf("ERROR: %s is not a PAK file\n", loader->filename);
+		exit(1);
+	}
+	if (header->version < PAK_VERSION_MIN || header->version > PAK_VERSION) {
+		printf("ERROR: %s has unsupported PAK version %u (expected %u-%u)\n", loader->filename, header->version,
+		       PAK_VERSION_MIN, PAK_VERSION);
+		exit(1);
+	}
+	if (loader->image == NULL && queue_image(loader, header)) {
+		free_table(loader, header);
+		return;
+	}
+	level->version = header->version;
+	level->stringTable = load_data(loader, header->string_table_length, header->string_table_offset, NULL, NULL);
+	level->assets = mem_alloc_scratch(sizeof(struct Asset) * header->directory_count, alignof(struct Asset));
+	level->numAssets = header->directory_count;
+
+	load_table(loader, sizeof(struct PAKDirectoryEntry) * header->directory_count, header->directory_offset,
+	           decode_directory);
+	free_table(loader, header);
+}
+
+static void decode_image(struct PAKLoader* loader, void* buffer, [[maybe_unused]] void* ud) {
+	loader->image = buffer;
+	decode_header(loader, buffer, NULL);
+}
+
+struct PAKLoader* pak_load_async(char* levelName) {
 	if (strlen(levelName) > 63) {
 		printf("ERROR: Level name exceeded maximum of 63 characters\n");
 		exit(1);
 	}
 
-	char filename[63 + 4 + 1];
-	snprintf(filename, 63 + 4 + 1, "%s.PAK", levelName);
-	struct FSTEntry* const file = fst_resolve_path(filename);
-	if (file == NULL) return NULL;
+	struct PAKLoader* const loader = malloc(sizeof(struct PAKLoader));
+	mem_checkOOM(loader);
+	snprintf(loader->filename, sizeof(loader->filename), "%s.PAK", levelName);
+	loader->file = fst_resolve_path(loader->filename);
+	if (loader->file == NULL) {
+		free(loader);
+		return NULL;
+	}
 
 	mem_reset_scratch();
-	struct Level* const level = mem_alloc_scratch(sizeof(struct Level), alignof(struct Level));
+	loader->level = mem_alloc_scratch(sizeof(struct Level), alignof(struct Level));
+	loader->head = NULL;
+	loader->tail = NULL;
+	loader->unissued = NULL;
+	loader->image = NULL;
+	loader->bytesLoaded = 0;
+
+	load_table(loader, sizeof(struct PAKHeader), 0, decode_header);
+	return loader;
+}
 
-	struct PAKHeader* const header = aligned_alloc(32, ROUNDUP32(sizeof(struct PAKHeader)));
-	mem_checkOOM(header);
-	fst_read_sync(file, header, ROUNDUP32(sizeof(struct PAKHeader)), 0);
-	level->stringTable = mem_alloc_scratch(ROUNDUP32(header->string_table_length), 32);
-	level->assets = mem_alloc_scratch(sizeof(struct Asset) * header->directory_count, alignof(struct Asset));
-	level->numAssets = header->directory_count;
-	fst_read_sync(file, level->stringTable, ROUNDUP32(header->string_table_length), header->string_table_offset);
-
-	struct PAKDirectoryEntry* const directory =
-	    aligned_alloc(32, ROUNDUP32(sizeof(struct PAKDirectoryEntry) * header->directory_count));
-	mem_checkOOM(directory);
-	fst_read_sync(file, directory, header->directory_count, header->directory_offset);
-	for (size_t i = 0; i < header->directory_count; i++) {
-		init_asset(file, level, &level->assets[i], &directory[i]);
+bool pak_poll(struct PAKLoader* loader) {
+	issue_reads(loader);
+	while (loader->head != NULL && loader->head->done) {
+		struct PAKRead* const read = loader->head;
+		if (read->result < 0) {
+			printf("ERROR: Failed to read %s (%d)\n", loader->filename, read->result);
+			exit(1);
+		}
+		loader->bytesLoaded += read->length;
+		if (read->decode != NULL) read->decode(loader, read->buffer, read->ud);
+
+		/* Decoding may have queued more reads behind this one */
+		loader->head = read->next;
+		if (loader->head == NULL) loader->tail = NULL;
+		free(read);
 	}
-	free(directory);
+	return loader->head == NULL;
+}
 
-	free(header);
+float pak_get_progress(struct PAKLoader const* loader) {
+	if (loader->file->length == 0) return 1;
+	return fminf((float)loader->bytesLoaded / (float)loader->file->length, 1);
+}
 
+struct Level* pak_finish(struct PAKLoader* loader) {
+	struct Level* const level = loader->level;
+	free(loader);
 	return level;
 }
+
+struct Level* pak_load(char* levelName) {
+	struct PAKLoader* const loader = pak_load_async(levelName);
+	if (loader == NULL) return NULL;
+	while (!pak_poll(loader)) {}
+	return pak_finish(loader);
+}
@@ -17,14 +17,128 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <stdlib.h>
+#include <stdalign.h>
+#include <math.h>
 #include <string.h>
 #include <gccore.h>
 #include "mem.h"
+#include "orca.h"
 #include "pak.h"
+#include "render.h"
 
 static float const VERY_FAR = 10E+18F; // Sufficiently large value safe for GameCube lighting hardware (<10e19)
+static float const FOVY = 70.0F;
+static float const Z_NEAR = 1.0F;
+static float const Z_FAR = 10000.0F;
 static void*       currentXFB = NULL;
 static Mtx         currentCamera;
+static uint32_t    cameraGeneration = 1; // Incremented whenever currentCamera changes
+static float       aspect;
+
+/* Points p for which n·p + d >= 0 are on the inside */
+struct Plane {
+	guVector n;
+	float    d;
+};
+
+enum FrustumPlane { PLANE_NEAR, PLANE_FAR, PLANE_LEFT, PLANE_RIGHT, PLANE_TOP, PLANE_BOTTOM, NUM_PLANES };
+
+static struct Plane frustum[NUM_PLANES]; // World space
+static uint32_t     frustumGeneration = 0; // Camera the frustum was computed for
+
+/* Vertex attributes tracked by the GX shadow state */
+enum ShadowAttr { SHADOW_POS, SHADOW_NRM, SHADOW_CLR0, SHADOW_TEX0, NUM_SHADOW_ATTRS };
+
+static uint8_t const SHADOW_ATTR_GX[NUM_SHADOW_ATTRS] = {GX_VA_POS, GX_VA_NRM, GX_VA_CLR0, GX_VA_TEX0};
+static uint8_t const SHADOW_UNKNOWN = 0xFF;
+
+/*
+ * Last value sent to GX for each piece of per-primitive state, so that commands which wouldn't change anything can be
+ * dropped instead of going through the FIFO. SHADOW_UNKNOWN (or NULL) forces the next command to be sent.
+ */
+static struct {
+	uint8_t vtxDesc[NUM_SHADOW_ATTRS];
+	struct {
+		uint8_t compCount;
+		uint8_t compType;
+		uint8_t frac;
+	} vtxAttrFmt[NUM_SHADOW_ATTRS];
+	struct {
+		void*   base;
+		uint8_t stride;
+	} array[NUM_SHADOW_ATTRS];
+	GXTexObj* texture;
+	uint8_t   diffuseSrc;
+} shadow;
+
+static struct RenderStats frameStats;
+static struct RenderStats lastFrameStats;
+
+static void shadow_reset(void) {
+	memset(&shadow, SHADOW_UNKNOWN, sizeof(shadow));
+	for (int a = 0; a < NUM_SHADOW_ATTRS; a++) {
+		shadow.array[a].base = NULL;
+	}
+	shadow.texture = NULL;
+}
+
+static void shadow_set_vtx_desc(enum ShadowAttr a, uint8_t type) {
+	if (shadow.vtxDesc[a] == type) {
+		frameStats.gxCommandsSkipped++;
+		return;
+	}
+	GX_SetVtxDesc(SHADOW_ATTR_GX[a], type);
+	shadow.vtxDesc[a] = type;
+	frameStats.gxCommands++;
+}
+
+static void shadow_set_vtx_attr_fmt(enum ShadowAttr a, uint8_t compCount, uint8_t compType, uint8_t frac) {
+	if (shadow.vtxAttrFmt[a].compCount == compCount && shadow.vtxAttrFmt[a].compType == compType &&
+	    shadow.vtxAttrFmt[a].frac == frac) {
+		frameStats.gxCommandsSkipped++;
+		return;
+	}
+	GX_SetVtxAttrFmt(GX_VTXFMT0, SHADOW_ATTR_GX[a], compCount, compType, frac);
+	shadow.vtxAttrFmt[a].compCount = compCount;
+	shadow.vtxAttrFmt[a].compType = compType;
+	shadow.vtxAttrFmt[a].frac = frac;
+	frameStats.gxCommands++;
+}
+
+static void shadow_set_array(enum ShadowAttr a, void* base, uint8_t stride) {
+	if (shadow.array[a].base == base && shadow.array[a].stride == stride) {
+		frameStats.gxCommandsSkipped++;
+		return;
+	}
+	GX_SetArray(SHADOW_ATTR_GX[a], base, stride);
+	shadow.array[a].base = base;
+	shadow.array[a].stride = stride;
+	frameStats.gxCommands++;
+}
+
+static void shadow_load_tex_obj(GXTexObj* texture) {
+	if (shadow.texture == texture) {
+		frameStats.gxCommandsSkipped++;
+		return;
+	}
+	GX_LoadTexObj(texture, GX_TEXMAP0);
+	shadow.texture = texture;
+	frameStats.gxCommands++;
+}
+
+static void shadow_set_chan_ctrl(uint8_t diffuseSrc) {
+	if (shadow.diffuseSrc == diffuseSrc) {
+		frameStats.gxCommandsSkipped++;
+		return;
+	}
+	GX_SetChanCtrl(GX_COLOR0A0, GX_TRUE, GX_SRC_REG, diffuseSrc, GX_LIGHT0, GX_DF_CLAMP, GX_AF_NONE);
+	shadow.diffuseSrc = diffuseSrc;
+	frameStats.gxCommands++;
+}
+
+struct RenderStats const* render_get_stats(void) {
+	return &lastFrameStats;
+}
 
 static GXRModeObj* get_rmode(void) {
 	static GXRModeObj* rmode = NULL;
@@ -46,6 +160,12 @@ static void set_xfb(void* xfb) {
 	VIDEO_Flush();
 }
 
+static void load_perspective(void) {
+	Mtx44 proj;
+	guPerspective(proj, FOVY, aspect, Z_NEAR, Z_FAR);
+	GX_LoadProjectionMtx(proj, GX_PERSPECTIVE);
+}
+
 void render_init(void) {
 #ifdef DEBUG
 	if (g_XFB0 == NULL || g_FIFO == NULL) {
@@ -65,6 +185,9 @@ void render_init(void) {
 
 	memset(g_FIFO, 0, render_get_fifosz()); // Clear FIFO so there's no garbage data present
 	GX_Init(g_FIFO, render_get_fifosz());
+	shadow_reset();
+	GX_ClearVtxDesc();
+	memset(shadow.vtxDesc, GX_NONE, sizeof(shadow.vtxDesc)); // Every attribute is now known to be GX_NONE
 	GX_SetDispCopyYScale(GX_GetYScaleFactor(rmode->efbHeight, rmode->xfbHeight));
 	GX_SetDispCopySrc(0, 0, rmode->fbWidth, rmode->efbHeight);
 	GX_SetDispCopyDst(rmode->fbWidth, rmode->xfbHeight);
@@ -75,6 +198,7 @@ void render_init(void) {
 #endif
 	GX_SetViewport(0.0F, 0.0F, rmode->fbWidth, rmode->xfbHeight, 0.0F, 1.0F);
 	GX_SetCullMode(GX_CULL_FRONT);
+	GX_SetCurrentMtx(GX_PNMTX0);
 	GX_SetClipMode(GX_CLIP_ENABLE);
 
 	GX_SetNumTevStages(1);
@@ -93,9 +217,8 @@ void render_init(void) {
 
 	guMtxIdentity(currentCamera);
 
-	Mtx44 proj;
-	guPerspective(proj, 70, (float)rmode->fbWidth / (float)rmode->xfbHeight, 1.0F, 10000.0F);
-	GX_LoadProjectionMtx(proj, GX_PERSPECTIVE);
+	aspect = (float)rmode->fbWidth / (float)rmode->xfbHeight;
+	load_perspective();
 }
 
 void render_ready(void) {
@@ -106,163 +229,783 @@ void render_ready(void) {
 	VIDEO_Flush();
 }
 
+static void draw_rect(float x0, float y0, float x1, float y1, GXColor color) {
+	GX_SetChanMatColor(GX_COLOR0A0, color);
+	GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+	GX_Position3f32(x0, y0, -0.5F);
+	GX_Position3f32(x1, y0, -0.5F);
+	GX_Position3f32(x1, y1, -0.5F);
+	GX_Position3f32(x0, y1, -0.5F);
+	GX_End();
+}
+
+/* Draws a frame with nothing but a progress bar, for use while a level is loading */
+void render_loading(float progress) {
+	GX_CopyDisp(currentXFB, GX_TRUE);
+	VIDEO_WaitVSync();
+
+	GXRModeObj* const rmode = get_rmode();
+	Mtx44             ortho;
+	guOrtho(ortho, 0, rmode->efbHeight, 0, rmode->fbWidth, 0, 1);
+	GX_LoadProjectionMtx(ortho, GX_ORTHOGRAPHIC);
+	Mtx identity;
+	guMtxIdentity(identity);
+	GX_LoadPosMtxImm(identity, GX_PNMTX0);
+
+	shadow_set_vtx_desc(SHADOW_POS, GX_DIRECT);
+	shadow_set_vtx_desc(SHADOW_NRM, GX_NONE);
+	shadow_set_vtx_desc(SHADOW_CLR0, GX_NONE);
+	shadow_set_vtx_desc(SHADOW_TEX0, GX_NONE);
+	shadow_set_vtx_attr_fmt(SHADOW_POS, GX_POS_XYZ, GX_F32, 0);
+	/* Unlit, untextured and double-sided; everything changed here is restored below */
+	GX_SetChanCtrl(GX_COLOR0A0, GX_FALSE, GX_SRC_REG, GX_SRC_REG, GX_LIGHTNULL, GX_DF_NONE, GX_AF_NONE);
+	shadow.diffuseSrc = SHADOW_UNKNOWN;
+	GX_SetTevOp(GX_TEVSTAGE0, GX_PASSCLR);
+	GX_SetCullMode(GX_CULL_NONE);
+
+	float const width = rmode->fbWidth * 0.6F;
+	float const x = (rmode->fbWidth - width) / 2;
+	float const y = rmode->efbHeight * 0.8F;
+	draw_rect(x, y, x + width, y + 8, (GXColor){64, 64, 64, 255});
+	draw_rect(x, y, x + width * fminf(fmaxf(progress, 0), 1), y + 8, (GXColor){255, 255, 255, 255});
+
+	GX_SetChanMatColor(GX_COLOR0A0, (GXColor){255, 255, 255, 255});
+	GX_SetCullMode(GX_CULL_FRONT);
+	GX_SetTevOp(GX_TEVSTAGE0, GX_MODULATE);
+	load_perspective();
+}
+
 void render_set_camera(Mtx camera) {
 	memcpy(currentCamera, camera, sizeof(Mtx));
+	cameraGeneration++;
+}
+
+static bool needs_color_correction(struct MeshPrimitive* const p) {
+	/*
+	 * The composer packs colors in a GX color format, so this is only a fallback for accessors it had to leave alone.
+	 * Float or u16 components must be corrected at runtime to u8 and sent with GX_DIRECT; u8 components are already
+	 * in a GX color format and can be indexed
+	 */
+	return p->attrColor != NULL &&
+	       (p->attrColor->componentType == COMPONENT_F32 || p->attrColor->componentType == COMPONENT_U16);
+}
+
+/* GX color format of a COLOR_n accessor as it is sent, 8 bits per channel unless the composer packed it */
+static uint8_t color_format(struct Accessor const* acr) {
+	if (acr->componentType == COMPONENT_COLOR) return acr->colorFormat;
+	return acr->elementType == ELEM_VEC4 ? GX_RGBA8 : GX_RGB8;
+}
+
+static size_t const COLOR_SIZES[] = {
+    [GX_RGB565] = 2, [GX_RGB8] = 3, [GX_RGBX8] = 4, [GX_RGBA4] = 2, [GX_RGBA6] = 3, [GX_RGBA8] = 4,
+};
+
+static bool has_texture(struct MeshPrimitive* const p) {
+	return (p->material != NULL) && ((p->attrTexCoord0 != NULL) || (p->attrTexCoord1 != NULL));
+}
+
+static struct Accessor* texcoord_accessor(struct MeshPrimitive* const p) {
+	return p->attrTexCoord0 != NULL ? p->attrTexCoord0 : p->attrTexCoord1;
+}
+
+static size_t vertex_count(struct MeshPrimitive* const p) {
+	return p->indices != NULL ? p->indices->count : p->attrPos->count;
+}
+
+static uint16_t vertex_index(struct MeshPrimitive* const p, size_t i) {
+	return p->indices != NULL ? ((uint16_t*)p->indices->buffer)[i] : i;
+}
+
+/* Primitives at most this many vertices long that use each vertex once are sent direct. Must match the composer */
+#define DIRECT_MAX_VERTICES 32
+
+static bool uses_each_vertex_once(struct MeshPrimitive* const p) {
+	if (p->indices->count != p->attrPos->count || p->attrPos->count > DIRECT_MAX_VERTICES) return false;
+	uint32_t seen = 0;
+	for (size_t i = 0; i < p->indices->count; i++) {
+		uint16_t const idx = ((uint16_t*)p->indices->buffer)[i];
+		if (idx >= DIRECT_MAX_VERTICES || (seen & (1U << idx))) return false;
+		seen |= 1U << idx;
+	}
+	return true;
+}
+
+/*
+ * How send_vertices() sends a primitive's attributes. Indices are as narrow as its vertex count allows (an index of all
+ * ones makes GX skip the vertex, so 255 vertices is the most GX_INDEX8 can address). Unindexed primitives, and small
+ * ones that never reuse a vertex, gain nothing from indexing, so their vertex data is sent as is.
+ */
+static uint8_t attr_type(struct MeshPrimitive* const p) {
+	if (p->indices == NULL || uses_each_vertex_once(p)) return GX_DIRECT;
+	return p->attrPos->count <= 0xFF ? GX_INDEX8 : GX_INDEX16;
+}
+
+/* Vertex descriptor used by send_vertices() */
+static struct VtxDesc immediate_desc(struct MeshPrimitive* const p) {
+	uint8_t const type = attr_type(p);
+	return (struct VtxDesc){
+	    .position = type,
+	    .normal = p->attrNormal != NULL ? type : GX_NONE,
+	    .color0 = p->attrColor == NULL ? GX_NONE : needs_color_correction(p) ? GX_DIRECT : type,
+	    .texCoord0 = has_texture(p) ? type : GX_NONE,
+	};
+}
+
+/* Sends one attribute of a vertex through the FIFO, in the form the vertex descriptor says it's in */
+typedef void (*AttrEmitter)(struct Accessor const* acr, uint16_t idx);
+
+static void emit_index8([[maybe_unused]] struct Accessor const* acr, uint16_t idx) {
+	wgPipe->U8 = idx;
+}
+
+static void emit_index16([[maybe_unused]] struct Accessor const* acr, uint16_t idx) {
+	wgPipe->U16 = idx;
+}
+
+static size_t const ELEMENT_COMPONENTS[] = {
+    [ELEM_SCALAR] = 1, [ELEM_VEC2] = 2, [ELEM_VEC3] = 3,  [ELEM_VEC4] = 4,
+    [ELEM_MAT2] = 4,   [ELEM_MAT3] = 9, [ELEM_MAT4] = 16,
+};
+
+/* The vertex format is set to the accessor's component type, so its data is sent as stored */
+static void emit_direct8(struct Accessor const* acr, uint16_t idx) {
+	uint8_t const* const element = (uint8_t const*)acr->buffer + idx * acr->stride;
+	for (size_t c = 0; c < ELEMENT_COMPONENTS[acr->elementType]; c++) {
+		wgPipe->U8 = element[c];
+	}
+}
+
+static void emit_direct16(struct Accessor const* acr, uint16_t idx) {
+	uint16_t const* const element = (uint16_t const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	for (size_t c = 0; c < ELEMENT_COMPONENTS[acr->elementType]; c++) {
+		wgPipe->U16 = element[c];
+	}
+}
+
+static void emit_direct32(struct Accessor const* acr, uint16_t idx) {
+	uint32_t const* const element = (uint32_t const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	for (size_t c = 0; c < ELEMENT_COMPONENTS[acr->elementType]; c++) {
+		wgPipe->U32 = element[c];
+	}
+}
+
+/*
+ * Float and u16 colors are converted to u8 as they're sent, as GX only takes u8 colors. The converter is chosen once
+ * per primitive by corrected_color()
+ */
+enum CorrectedColor {
+	CORRECTED_F32_RGBA,
+	CORRECTED_F32_RGB,
+	CORRECTED_U16_RGBA,
+	CORRECTED_U16_RGB,
+	NUM_CORRECTED_COLORS
+};
+
+static void emit_color_f32_rgba(struct Accessor const* acr, uint16_t idx) {
+	float const* const c = (float const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	GX_Color4u8(c[0] * 255, c[1] * 255, c[2] * 255, c[3] * 255);
+}
+
+static void emit_color_f32_rgb(struct Accessor const* acr, uint16_t idx) {
+	float const* const c = (float const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	GX_Color3u8(c[0] * 255, c[1] * 255, c[2] * 255);
+}
+
+static void emit_color_u16_rgba(struct Accessor const* acr, uint16_t idx) {
+	uint16_t const* const c = (uint16_t const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	GX_Color4u8(c[0] >> 8, c[1] >> 8, c[2] >> 8, c[3] >> 8);
+}
+
+static void emit_color_u16_rgb(struct Accessor const* acr, uint16_t idx) {
+	uint16_t const* const c = (uint16_t const*)((uint8_t const*)acr->buffer + idx * acr->stride);
+	GX_Color3u8(c[0] >> 8, c[1] >> 8, c[2] >> 8);
 }
 
-static void send_corrected_color(struct Accessor* acr, uint16_t idx) {
-	float*    rgba_f32 = (float*)((uint8_t*)acr->buffer + (idx * acr->stride));
-	uint16_t* rgba_u16 = (uint16_t*)((uint8_t*)acr->buffer + (idx * acr->stride));
+static AttrEmitter const CORRECTED_COLOR_EMITTERS[NUM_CORRECTED_COLORS] = {
+    [CORRECTED_F32_RGBA] = emit_color_f32_rgba,
+    [CORRECTED_F32_RGB] = emit_color_f32_rgb,
+    [CORRECTED_U16_RGBA] = emit_color_u16_rgba,
+    [CORRECTED_U16_RGB] = emit_color_u16_rgb,
+};
+
+static enum CorrectedColor corrected_color(struct Accessor const* acr) {
+	bool const rgba = acr->elementType == ELEM_VEC4;
+	if (!rgba && acr->elementType != ELEM_VEC3) {
+		printf("ERROR: Invalid COLOR_n element type: '%d'", acr->elementType);
+		exit(1);
+	}
 	switch (acr->componentType) {
 	case COMPONENT_F32:
-		switch (acr->elementType) {
-		case ELEM_VEC4:
-			GX_Color4u8(rgba_f32[0] * 255, rgba_f32[1] * 255, rgba_f32[2] * 255, rgba_f32[3] * 255);
-			break;
-		case ELEM_VEC3:
-			GX_Color3u8(rgba_f32[0] * 255, rgba_f32[1] * 255, rgba_f32[2] * 255);
-			break;
-		default:
-			printf("ERROR: Invalid COLOR_n element type: '%d'", acr->elementType);
-			exit(1);
-			break;
-		}
-		break;
+		return rgba ? CORRECTED_F32_RGBA : CORRECTED_F32_RGB;
 	case COMPONENT_U16:
-		switch (acr->elementType) {
-		case ELEM_VEC4:
-			GX_Color4u8(rgba_u16[0] >> 8, rgba_u16[1] >> 8, rgba_u16[2] >> 8, rgba_u16[3] >> 8);
-			break;
-		case ELEM_VEC3:
-			GX_Color3u8(rgba_u16[0] >> 8, rgba_u16[1] >> 8, rgba_u16[2] >> 8);
-			break;
-		default:
-			printf("ERROR: Invalid COLOR_n element type: '%d'", acr->elementType);
-			exit(1);
-			break;
-		}
-		break;
+		return rgba ? CORRECTED_U16_RGBA : CORRECTED_U16_RGB;
 	default:
 		printf("ERROR: Invalid COLOR_n component type: '%d'", acr->componentType);
 		exit(1);
-		break;
+	}
+}
+
+static void emit_direct_color(struct Accessor const* acr, uint16_t idx) {
+	uint8_t const* const color = (uint8_t const*)acr->buffer + idx * acr->stride;
+	for (size_t b = 0; b < COLOR_SIZES[acr->colorFormat]; b++) {
+		wgPipe->U8 = color[b];
+	}
+}
+
+static AttrEmitter const INDEX_EMITTERS[] = {[GX_INDEX8] = emit_index8, [GX_INDEX16] = emit_index16};
+static AttrEmitter const DIRECT_EMITTERS[] = {
+    [COMPONENT_F32] = emit_direct32, [COMPONENT_S8] = emit_direct8,   [COMPONENT_U8] = emit_direct8,
+    [COMPONENT_S16] = emit_direct16, [COMPONENT_U16] = emit_direct16, [COMPONENT_COLOR] = emit_direct_color,
+};
+static size_t const COMPONENT_SIZES[] = {
+    [COMPONENT_F32] = 4, [COMPONENT_S8] = 1, [COMPONENT_U8] = 1, [COMPONENT_S16] = 2, [COMPONENT_U16] = 2,
+};
+
+/* Emitters for each attribute of a primitive in the order GX expects them, chosen once rather than for each vertex */
+struct VertexEmitters {
+	size_t                 numAttrs;
+	size_t                 vertexSize; // Bytes sent per vertex
+	AttrEmitter            emit[NUM_SHADOW_ATTRS];
+	struct Accessor const* accessor[NUM_SHADOW_ATTRS];
+};
+
+static void add_emitter(struct VertexEmitters* e, uint8_t type, struct Accessor const* acr) {
+	if (type == GX_NONE) return;
+	if (type == GX_DIRECT) {
+		e->emit[e->numAttrs] = DIRECT_EMITTERS[acr->componentType];
+		e->vertexSize += acr->componentType == COMPONENT_COLOR
+		                     ? COLOR_SIZES[acr->colorFormat]
+		                     : COMPONENT_SIZES[acr->componentType] * ELEMENT_COMPONENTS[acr->elementType];
+	} else {
+		e->emit[e->numAttrs] = INDEX_EMITTERS[type];
+		e->vertexSize += type == GX_INDEX8 ? sizeof(uint8_t) : sizeof(uint16_t);
+	}
+	e->accessor[e->numAttrs] = acr;
+	e->numAttrs++;
+}
+
+static struct VertexEmitters vertex_emitters(struct MeshPrimitive* const p) {
+	struct VertexEmitters e = {0};
+	add_emitter(&e, p->desc.position, p->attrPos);
+	add_emitter(&e, p->desc.normal, p->attrNormal);
+	if (needs_color_correction(p)) {
+		e.emit[e.numAttrs] = CORRECTED_COLOR_EMITTERS[corrected_color(p->attrColor)];
+		e.accessor[e.numAttrs] = p->attrColor;
+		e.vertexSize += p->attrColor->elementType == ELEM_VEC4 ? 4 : 3;
+		e.numAttrs++;
+	} else {
+		add_emitter(&e, p->desc.color0, p->attrColor);
+	}
+	add_emitter(&e, p->desc.texCoord0, texcoord_accessor(p));
+	return e;
+}
+
+/*
+ * Attributes the composer interleaved share one stream: each gets its own base pointer within it, all with the stream's
+ * stride, so a vertex's attributes are fetched from neighbouring bytes
+ */
+static void set_vertex_state(struct MeshPrimitive* const p) {
+	shadow_set_vtx_desc(SHADOW_POS, p->desc.position);
+	shadow_set_vtx_attr_fmt(SHADOW_POS, GX_POS_XYZ, p->attrPos->componentType, p->attrPos->frac);
+	shadow_set_array(SHADOW_POS, p->attrPos->buffer, p->attrPos->stride);
+
+	bool const hasColor = p->desc.color0 != GX_NONE;
+	shadow_set_vtx_desc(SHADOW_NRM, p->desc.normal);
+	if (p->desc.normal != GX_NONE) {
+		shadow_set_vtx_attr_fmt(SHADOW_NRM, GX_NRM_XYZ, p->attrNormal->componentType, p->attrNormal->frac);
+		shadow_set_array(SHADOW_NRM, p->attrNormal->buffer, p->attrNormal->stride);
+	}
+	shadow_set_vtx_desc(SHADOW_CLR0, p->desc.color0);
+	if (hasColor) {
+		if (p->desc.color0 != GX_DIRECT) shadow_set_array(SHADOW_CLR0, p->attrColor->buffer, p->attrColor->stride);
+
+		int const compCount = p->attrColor->elementType == ELEM_VEC4 ? GX_CLR_RGBA : GX_CLR_RGB;
+		shadow_set_vtx_attr_fmt(SHADOW_CLR0, compCount, color_format(p->attrColor), 0);
+	}
+	shadow_set_vtx_desc(SHADOW_TEX0, p->desc.texCoord0);
+	if (p->desc.texCoord0 != GX_NONE) {
+		struct Accessor* const texCoord = texcoord_accessor(p);
+		shadow_set_vtx_attr_fmt(SHADOW_TEX0, GX_TEX_ST, texCoord->componentType, texCoord->frac);
+		shadow_set_array(SHADOW_TEX0, texCoord->buffer, texCoord->stride);
+		shadow_load_tex_obj(p->material->texture);
+	}
+
+	shadow_set_chan_ctrl(hasColor ? GX_SRC_VTX : GX_SRC_REG);
+}
+
+/*
+ * Per-vertex loops specialized for each combination of index width and attributes, so that nothing is decided per
+ * vertex. Every indexed attribute of a vertex is sent the same index; EMIT_INDEX_n sends it for n attributes.
+ */
+#define EMIT_INDEX_0(T, idx) ((void)0)
+#define EMIT_INDEX_1(T, idx) (wgPipe->T = (idx))
+#define EMIT_INDEX_2(T, idx) (EMIT_INDEX_1(T, idx), EMIT_INDEX_1(T, idx))
+#define EMIT_INDEX_3(T, idx) (EMIT_INDEX_2(T, idx), EMIT_INDEX_1(T, idx))
+#define EMIT_INDEX_4(T, idx) (EMIT_INDEX_3(T, idx), EMIT_INDEX_1(T, idx))
+
+typedef void (*SendIndexed)(uint16_t const* indices, size_t count);
+
+/* Sends N indices of type T for each vertex, unrolled four vertices at a time */
+#define DEFINE_SEND_INDEXED(T, N)                                                                                      \
+	static void send_indexed_##T##_##N(uint16_t const* indices, size_t count) {                                        \
+		size_t i = 0;                                                                                                  \
+		for (; i + 4 <= count; i += 4) {                                                                               \
+			EMIT_INDEX_##N(T, indices[i]);                                                                             \
+			EMIT_INDEX_##N(T, indices[i + 1]);                                                                         \
+			EMIT_INDEX_##N(T, indices[i + 2]);                                                                         \
+			EMIT_INDEX_##N(T, indices[i + 3]);                                                                         \
+		}                                                                                                              \
+		for (; i < count; i++) {                                                                                       \
+			EMIT_INDEX_##N(T, indices[i]);                                                                             \
+		}                                                                                                              \
+	}
+
+DEFINE_SEND_INDEXED(U8, 1)
+DEFINE_SEND_INDEXED(U8, 2)
+DEFINE_SEND_INDEXED(U8, 3)
+DEFINE_SEND_INDEXED(U8, 4)
+DEFINE_SEND_INDEXED(U16, 1)
+DEFINE_SEND_INDEXED(U16, 2)
+DEFINE_SEND_INDEXED(U16, 3)
+DEFINE_SEND_INDEXED(U16, 4)
+
+/* By index width, then number of attributes */
+static SendIndexed const SEND_INDEXED[][NUM_SHADOW_ATTRS + 1] = {
+    [GX_INDEX8] = {NULL, send_indexed_U8_1, send_indexed_U8_2, send_indexed_U8_3, send_indexed_U8_4},
+    [GX_INDEX16] = {NULL, send_indexed_U16_1, send_indexed_U16_2, send_indexed_U16_3, send_indexed_U16_4},
+};
+
+typedef void (*SendCorrected)(uint16_t const* indices, size_t count, struct Accessor const* color);
+
+/*
+ * Sends BEFORE indices (position and normal), the color converted by emit_color_COLOR(), then AFTER indices (texture
+ * coordinates) for each vertex
+ */
+#define DEFINE_SEND_CORRECTED(T, BEFORE, AFTER, COLOR)                                                                 \
+	static void send_corrected_##T##_##BEFORE##_##AFTER##_##COLOR(uint16_t const* indices, size_t count,               \
+	                                                             struct Accessor const* color) {                       \
+		for (size_t i = 0; i < count; i++) {                                                                           \
+			uint16_t const idx = indices[i];                                                                           \
+			EMIT_INDEX_##BEFORE(T, idx);                                                                               \
+			emit_color_##COLOR(color, idx);                                                                            \
+			EMIT_INDEX_##AFTER(T, idx);                                                                                \
+		}                                                                                                              \
+	}
+#define DEFINE_SEND_CORRECTED_COLORS(T, BEFORE, AFTER)                                                                 \
+	DEFINE_SEND_CORRECTED(T, BEFORE, AFTER, f32_rgba)                                                                  \
+	DEFINE_SEND_CORRECTED(T, BEFORE, AFTER, f32_rgb)                                                                   \
+	DEFINE_SEND_CORRECTED(T, BEFORE, AFTER, u16_rgba)                                                                  \
+	DEFINE_SEND_CORRECTED(T, BEFORE, AFTER, u16_rgb)
+/* Initializer of the SEND_CORRECTED entries for each enum CorrectedColor */
+#define SEND_CORRECTED_COLORS(T, BEFORE, AFTER)                                                                        \
+	{                                                                                                                  \
+	    send_corrected_##T##_##BEFORE##_##AFTER##_f32_rgba,                                                            \
+	    send_corrected_##T##_##BEFORE##_##AFTER##_f32_rgb,                                                             \
+	    send_corrected_##T##_##BEFORE##_##AFTER##_u16_rgba,                                                            \
+	    send_corrected_##T##_##BEFORE##_##AFTER##_u16_rgb,                                                             \
+	}
+
+DEFINE_SEND_CORRECTED_COLORS(U8, 1, 0)
+DEFINE_SEND_CORRECTED_COLORS(U8, 1, 1)
+DEFINE_SEND_CORRECTED_COLORS(U8, 2, 0)
+DEFINE_SEND_CORRECTED_COLORS(U8, 2, 1)
+DEFINE_SEND_CORRECTED_COLORS(U16, 1, 0)
+DEFINE_SEND_CORRECTED_COLORS(U16, 1, 1)
+DEFINE_SEND_CORRECTED_COLORS(U16, 2, 0)
+DEFINE_SEND_CORRECTED_COLORS(U16, 2, 1)
+
+/* By index width, whether there are normals, whether there are texture coordinates, then enum CorrectedColor */
+static SendCorrected const SEND_CORRECTED[][2][2][NUM_CORRECTED_COLORS] = {
+    [GX_INDEX8] = {{SEND_CORRECTED_COLORS(U8, 1, 0), SEND_CORRECTED_COLORS(U8, 1, 1)},
+                   {SEND_CORRECTED_COLORS(U8, 2, 0), SEND_CORRECTED_COLORS(U8, 2, 1)}},
+    [GX_INDEX16] = {{SEND_CORRECTED_COLORS(U16, 1, 0), SEND_CORRECTED_COLORS(U16, 1, 1)},
+                    {SEND_CORRECTED_COLORS(U16, 2, 0), SEND_CORRECTED_COLORS(U16, 2, 1)}},
+};
+
+static void send_vertices(struct MeshPrimitive* const p) {
+	size_t const count = vertex_count(p);
+	uint8_t const type = p->desc.position;
+
+	GX_Begin(p->mode, GX_VTXFMT0, count);
+	if (type == GX_DIRECT) {
+		/* Only unindexed or small primitives, not worth a loop of their own */
+		struct VertexEmitters const e = vertex_emitters(p);
+		for (size_t i = 0; i < count; i++) {
+			uint16_t const idx = vertex_index(p, i);
+			for (size_t a = 0; a < e.numAttrs; a++) {
+				e.emit[a](e.accessor[a], idx);
+			}
+		}
+	} else if (needs_color_correction(p)) {
+		bool const hasNormal = p->desc.normal != GX_NONE;
+		bool const hasTexture = p->desc.texCoord0 != GX_NONE;
+		SEND_CORRECTED[type][hasNormal][hasTexture][corrected_color(p->attrColor)](p->indices->buffer, count,
+		                                                                            p->attrColor);
+	} else {
+		size_t const numAttrs = 1 + (p->desc.normal != GX_NONE) + (p->desc.color0 != GX_NONE) +
+		                        (p->desc.texCoord0 != GX_NONE);
+		SEND_INDEXED[type][numAttrs](p->indices->buffer, count);
+	}
+	GX_End();
+}
+
+/*
+ * Records the vertex stream of a primitive into a display list so that drawing it no longer requires feeding the FIFO
+ * one index at a time. Vertex descriptors, formats and arrays are not part of the list and are set before each call.
+ * Primitives whose colors must be corrected on the CPU are left to the immediate mode path, and primitives with a list
+ * baked by the composer are left as they are.
+ */
+static void compile_primitive(struct MeshPrimitive* const p) {
+	if (p->displayList != NULL) return;
+	if (p->attrPos == NULL) return;
+
+	p->desc = immediate_desc(p);
+	if (needs_color_correction(p)) return;
+
+	/* GX_Begin command (1B) + vertex count (2B) + the vertex stream, plus room for padding */
+	size_t const bufsz = ROUNDUP32(3 + vertex_emitters(p).vertexSize * vertex_count(p)) + 32;
+	void* const  list = mem_alloc_scratch(bufsz, 32);
+
+	/* Vertex state is flushed by GX_BeginDispList, so only the draw itself ends up in the list */
+	set_vertex_state(p);
+	DCInvalidateRange(list, bufsz);
+	GX_BeginDispList(list, bufsz);
+	send_vertices(p);
+	size_t const size = GX_EndDispList();
+	if (size == 0) {
+		printf("WARNING: Display list overflowed %uB buffer, falling back to immediate mode\n", (uint32_t)bufsz);
+		return;
+	}
+
+	p->displayList = list;
+	p->displayListSize = size;
+}
+
+void render_prepare_model(struct Model* model) {
+	for (struct MeshPrimitive* p = model->primitives; p < model->primitives + model->numPrimitives; p++) {
+		compile_primitive(p);
 	}
 }
 
 static void draw_primitive(struct MeshPrimitive* const p) {
-	/* 3.2.7.1 When positions are not specified, client implementations SHOULD skip primitive’s rendering  */
 	if (p->attrPos == NULL) return;
 
-	if (p->indices == NULL) {
-		printf("Not yet implemented/%s:%u\n", __func__, __LINE__);
-		exit(1);
+	set_vertex_state(p);
+	if (p->displayList != NULL) {
+		GX_CallDispList(p->displayList, p->displayListSize);
+	} else {
+		send_vertices(p);
+	}
+}
+
+/*
+ * One primitive to be drawn this frame. Items are sorted by state (material, then vertex format) so that consecutive
+ * draws share as much GX state as possible, then front-to-back so that early-Z rejects occluded fragments.
+ */
+struct DrawItem {
+	uint32_t              stateKey;
+	float                 depth; // Distance in front of the camera
+	struct MeshPrimitive* primitive;
+	MtxP                  modelView;
+};
+
+/* Items past what fits are not dropped: the queue is drawn and emptied when full, sorting each batch separately */
+#define DRAW_QUEUE_CAPACITY 2048
+
+struct DrawQueue {
+	struct DrawItem* items; // DRAW_QUEUE_CAPACITY items, from the frame arena
+	size_t           count;
+};
+
+static uint32_t state_key(struct Model* model, struct MeshPrimitive* const p) {
+	uint32_t const material = p->material == NULL ? 0 : (uint32_t)(p->material - model->materials) + 1;
+	uint32_t const format = p->desc.position << 6 | p->desc.normal << 4 | p->desc.color0 << 2 | p->desc.texCoord0;
+	return material << 8 | format;
+}
+
+static int compare_draw_items(void const* _a, void const* _b) {
+	struct DrawItem const* const a = _a;
+	struct DrawItem const* const b = _b;
+	if (a->stateKey != b->stateKey) return a->stateKey < b->stateKey ? -1 : 1;
+	if (a->depth != b->depth) return a->depth < b->depth ? -1 : 1;
+	return 0;
+}
+
+static float dot(guVector const* a, guVector const* b) {
+	return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+/*
+ * Transforms the view space frustum (a function of the projection set in render_init) into world space, so that
+ * bounds can be tested without bringing them into view space first. Assumes the camera matrix has no scale.
+ */
+static void update_frustum(void) {
+	float const  ty = tanf(DegToRad(FOVY) / 2);
+	float const  tx = ty * aspect;
+	struct Plane view[NUM_PLANES] = {
+	    [PLANE_NEAR] = {{0, 0, -1}, -Z_NEAR},
+	    [PLANE_FAR] = {{0, 0, 1}, Z_FAR},
+	    [PLANE_LEFT] = {{1, 0, -tx}, 0},
+	    [PLANE_RIGHT] = {{-1, 0, -tx}, 0},
+	    [PLANE_TOP] = {{0, -1, -ty}, 0},
+	    [PLANE_BOTTOM] = {{0, 1, -ty}, 0},
+	};
+
+	guVector const t = {currentCamera[0][3], currentCamera[1][3], currentCamera[2][3]};
+	for (int i = 0; i < NUM_PLANES; i++) {
+		float const len = sqrtf(dot(&view[i].n, &view[i].n));
+		guVector    n = {view[i].n.x / len, view[i].n.y / len, view[i].n.z / len};
+		/* view = R * world + t, so n·view + d = (Rᵀn)·world + (n·t + d) */
+		frustum[i].n.x = currentCamera[0][0] * n.x + currentCamera[1][0] * n.y + currentCamera[2][0] * n.z;
+		frustum[i].n.y = currentCamera[0][1] * n.x + currentCamera[1][1] * n.y + currentCamera[2][1] * n.z;
+		frustum[i].n.z = currentCamera[0][2] * n.x + currentCamera[1][2] * n.y + currentCamera[2][2] * n.z;
+		frustum[i].d = dot(&n, &t) + view[i].d / len;
+	}
+	frustumGeneration = cameraGeneration;
+}
+
+static bool sphere_visible(guVector const* center, float radius) {
+	if (radius < 0) return false; // Nothing to draw
+	for (int i = 0; i < NUM_PLANES; i++) {
+		if (dot(&frustum[i].n, center) + frustum[i].d < -radius) return false;
+	}
+	return true;
+}
+
+/* Tests a world space box given by its center and half extents */
+static bool box_visible(guVector const* center, guVector const* extent) {
+	for (int i = 0; i < NUM_PLANES; i++) {
+		guVector const* const n = &frustum[i].n;
+		float const           r = fabsf(n->x) * extent->x + fabsf(n->y) * extent->y + fabsf(n->z) * extent->z;
+		if (dot(n, center) + frustum[i].d < -r) return false;
+	}
+	return true;
+}
+
+static bool aabb_visible(MtxP world, guVector const* min, guVector const* max) {
+	if (min->x > max->x) return true; // Unknown bounds
+
+	/* Transform the box's center and half extents, then test it as a box centered on the world space center */
+	guVector center = {(min->x + max->x) / 2, (min->y + max->y) / 2, (min->z + max->z) / 2};
+	guVector const half = {(max->x - min->x) / 2, (max->y - min->y) / 2, (max->z - min->z) / 2};
+	guVecMultiply(world, &center, &center);
+	guVector const extent = {
+	    fabsf(world[0][0]) * half.x + fabsf(world[0][1]) * half.y + fabsf(world[0][2]) * half.z,
+	    fabsf(world[1][0]) * half.x + fabsf(world[1][1]) * half.y + fabsf(world[1][2]) * half.z,
+	    fabsf(world[2][0]) * half.x + fabsf(world[2][1]) * half.y + fabsf(world[2][2]) * half.z,
+	};
+	return box_visible(&center, &extent);
+}
+
+/* Largest factor by which the matrix scales any direction (the length of its longest basis vector) */
+static float max_scale(MtxP m) {
+	float largest = 0;
+	for (int col = 0; col < 3; col++) {
+		largest = fmaxf(largest, m[0][col] * m[0][col] + m[1][col] * m[1][col] + m[2][col] * m[2][col]);
+	}
+	return sqrtf(largest);
+}
+
+/* Grows the sphere (center, radius) to enclose another; a negative radius is an empty sphere */
+static void sphere_merge(guVector* center, float* radius, guVector const* other, float otherRadius) {
+	if (otherRadius < 0) return;
+	if (*radius < 0) {
+		*center = *other;
+		*radius = otherRadius;
 		return;
 	}
 
-	GX_ClearVtxDesc();
+	guVector const d = {other->x - center->x, other->y - center->y, other->z - center->z};
+	float const    dist = sqrtf(dot(&d, &d));
+	if (dist + otherRadius <= *radius) return;
+	if (dist + *radius <= otherRadius) {
+		*center = *other;
+		*radius = otherRadius;
+		return;
+	}
 
-	GX_SetVtxDesc(GX_VA_POS, GX_INDEX16);
-	GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, p->attrPos->componentType, 0);
-	GX_SetArray(GX_VA_POS, p->attrPos->buffer, p->attrPos->stride);
+	float const merged = (dist + *radius + otherRadius) / 2;
+	float const t = (merged - *radius) / dist;
+	center->x += d.x * t;
+	center->y += d.y * t;
+	center->z += d.z * t;
+	*radius = merged;
+}
 
-	bool const hasNormal = p->attrNormal != NULL;
-	bool const hasColor = p->attrColor != NULL;
-	/*
-	 * If color components are float or u16, they must be corrected at runtime to u8 and sent with GX_DIRECT; the
-	 * only other valid component type for COLOR_n is u8, which can be sent with GX_INDEX16 as it's already the
-	 * correct format
-	 */
-	bool const indexColor = hasColor && p->attrColor->componentType == COMPONENT_U8;
-	bool const hasTexture = (p->material != NULL) && ((p->attrTexCoord0 != NULL) || (p->attrTexCoord1 != NULL));
-	if (hasNormal) {
-		GX_SetVtxDesc(GX_VA_NRM, GX_INDEX16);
-		GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, p->attrNormal->componentType, 0);
-		GX_SetArray(GX_VA_NRM, p->attrNormal->buffer, p->attrNormal->stride);
+/*
+ * Brings the cached matrices of a subtree up to date. Only nodes which were marked dirty, or whose parent's world
+ * matrix changed, are recomputed, along with the world space bounds of changed nodes and their ancestors. Nodes that
+ * change after the model was first posed are flagged as moved. Returns whether the node's bounds changed.
+ */
+static bool update_tree(struct Model* model, struct Node* node, bool parentChanged) {
+	bool const changed = node->dirty || parentChanged;
+	if (node->dirty) {
+		guMtxScale(node->local, node->scale.x, node->scale.y, node->scale.z);
+		Mtx rot;
+		guMtxQuat(rot, &node->rotation);
+		guMtxConcat(rot, node->local, node->local);
+		guMtxTransApply(node->local, node->local, node->translation.x, node->translation.y, node->translation.z);
+		node->dirty = false;
 	}
-	if (hasColor) {
-		if (indexColor) {
-			GX_SetVtxDesc(GX_VA_CLR0, GX_INDEX16);
-			GX_SetArray(GX_VA_CLR0, p->attrColor->buffer, p->attrColor->stride);
+	if (changed) {
+		if (node->parent != NULL) {
+			guMtxConcat(node->parent->world, node->local, node->world);
 		} else {
-			GX_SetVtxDesc(GX_VA_CLR0, GX_DIRECT);
+			guMtxCopy(node->local, node->world);
 		}
+		node->modelViewGeneration = 0;
+		if (model->posed) node->moved = true;
+	}
 
-		int const compCount = p->attrColor->elementType == ELEM_VEC4 ? GX_CLR_RGBA : GX_CLR_RGB;
-		GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, compCount, GX_U8, 0);
+	bool childBoundsChanged = false;
+	node->movedSubtree = node->moved;
+	for (size_t i = 0; i < node->numChildren; i++) {
+		struct Node* const child = model->nodes + node->childrenIdxs[i];
+		childBoundsChanged |= update_tree(model, child, changed);
+		node->movedSubtree |= child->movedSubtree;
+	}
+	if (!changed && !childBoundsChanged) return false;
+
+	if (node->boundsRadius < 0) {
+		node->worldRadius = -1;
+	} else {
+		guVecMultiply(node->world, &node->boundsCenter, &node->worldCenter);
+		node->worldRadius = node->boundsRadius * max_scale(node->world);
+	}
+	for (size_t i = 0; i < node->numChildren; i++) {
+		struct Node* const child = model->nodes + node->childrenIdxs[i];
+		sphere_merge(&node->worldCenter, &node->worldRadius, &child->worldCenter, child->worldRadius);
 	}
-	if (hasTexture) {
-		struct Accessor* const texCoord = p->attrTexCoord0 ? p->attrTexCoord0 : p->attrTexCoord1;
-		GX_SetVtxDesc(GX_VA_TEX0, GX_INDEX16);
-		GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0, GX_TEX_ST, texCoord->componentType, 0);
-		GX_SetArray(GX_VA_TEX0, texCoord->buffer, texCoord->stride);
-		GX_LoadTexObj(p->material->texture, GX_TEXMAP0);
+	return true;
+}
+
+/* Modelview matrix of a node, computed on first use after the camera or the node moved */
+static MtxP node_model_view(struct Node* node) {
+	if (node->modelViewGeneration != cameraGeneration) {
+		guMtxConcat(currentCamera, node->world, node->modelView);
+		node->modelViewGeneration = cameraGeneration;
 	}
+	return node->modelView;
+}
 
-	GX_SetChanCtrl(GX_COLOR0A0, GX_TRUE, GX_SRC_REG, hasColor ? GX_SRC_VTX : GX_SRC_REG, GX_LIGHT0, GX_DF_CLAMP,
-	               GX_AF_NONE);
+/* Draws the queued items in state order and empties the queue */
+static void flush_queue(struct DrawQueue* queue) {
+	qsort(queue->items, queue->count, sizeof(struct DrawItem), compare_draw_items);
 
-	GX_Begin(p->mode, GX_VTXFMT0, p->indices->count);
-	for (size_t i = 0; i < p->indices->count; i++) {
-		uint16_t const idx = ((uint16_t*)p->indices->buffer)[i];
-		GX_Position1x16(idx);
-		if (hasNormal) GX_Normal1x16(idx);
-		if (indexColor) {
-			GX_Color1x16(idx);
-		} else if (hasColor) { // (&& !indexColor) Float or u16, components must be corrected and sent direct
-			send_corrected_color(p->attrColor, idx);
+	MtxP loaded = NULL;
+	for (struct DrawItem* item = queue->items; item < queue->items + queue->count; item++) {
+		if (item->modelView != loaded) {
+			GX_LoadPosMtxImm(item->modelView, GX_PNMTX0);
+			GX_LoadNrmMtxImm(item->modelView, GX_PNMTX0);
+			loaded = item->modelView;
 		}
-		if (hasTexture) GX_TexCoord1x16(idx);
+		draw_primitive(item->primitive);
 	}
-	GX_End();
+	frameStats.primitives += queue->count;
+	queue->count = 0;
 }
 
-static void draw_tree(struct Node* node, Mtx _parentM, struct Model* model) {
-	Mtx parentM;
-	if (_parentM != NULL) {
-		memcpy(parentM, _parentM, sizeof(Mtx));
-	} else {
-		guMtxIdentity(parentM);
+static void gather_primitive(struct DrawQueue* queue, struct Model* model, struct Node* node,
+                             struct MeshPrimitive* const p) {
+	/* 3.2.7.1 When positions are not specified, client implementations SHOULD skip primitive’s rendering  */
+	if (p->attrPos == NULL) return;
+	if (!aabb_visible(node->world, &p->boundsMin, &p->boundsMax)) {
+		frameStats.primitivesCulled++;
+		return;
 	}
 
-	Mtx m;
-	guMtxScale(m, node->scale.x, node->scale.y, node->scale.z);
-	Mtx rot;
-	guMtxQuat(rot, &node->rotation);
-	guMtxConcat(rot, m, m);
-	guMtxTransApply(m, m, node->translation.x, node->translation.y, node->translation.z);
-	guMtxConcat(parentM, m, m);
+	if (queue->count == DRAW_QUEUE_CAPACITY) flush_queue(queue);
+	struct DrawItem* const item = queue->items + queue->count++;
 
-	if (node->mesh != NULL) {
-		Mtx mv;
-		guMtxConcat(currentCamera, m, mv);
-		GX_LoadPosMtxImm(mv, GX_PNMTX0);
-		GX_LoadNrmMtxImm(mv, GX_PNMTX0);
-		GX_SetCurrentMtx(GX_PNMTX0);
+	MtxP const modelView = node_model_view(node);
+	item->stateKey = state_key(model, p);
+	item->depth = -modelView[2][3]; // The camera looks down -Z
+	item->primitive = p;
+	item->modelView = modelView;
+}
+
+/* If `movedOnly` is set, only moved nodes are gathered and the rest are left to gather_bvh() */
+static void gather_tree(struct DrawQueue* queue, struct Node* node, struct Model* model, bool movedOnly) {
+	if (movedOnly && !node->movedSubtree) return;
+	if (!sphere_visible(&node->worldCenter, node->worldRadius)) {
+		frameStats.subtreesCulled++;
+		return;
+	}
 
+	if (node->mesh != NULL && (node->moved || !movedOnly)) {
 		for (size_t i = 0; i < node->mesh->numPrimitives; i++) {
-			draw_primitive(model->primitives + node->mesh->primitivesIdxs[i]);
+			gather_primitive(queue, model, node, model->primitives + node->mesh->primitivesIdxs[i]);
 		}
 	}
 
 	for (size_t i = 0; i < node->numChildren; i++) {
-		draw_tree(model->nodes + node->childrenIdxs[i], m, model);
+		gather_tree(queue, model->nodes + node->childrenIdxs[i], model, movedOnly);
 	}
 }
 
-static void draw_scene(struct Scene* scene, struct Model* model) {
+static void gather_scene(struct DrawQueue* queue, struct Scene* scene, struct Model* model, bool movedOnly) {
 	for (size_t i = 0; i < scene->numNodes; i++) {
 		struct Node* const n = model->nodes + scene->nodesIdxs[i];
-		draw_tree(n, NULL, model);
+		gather_tree(queue, n, model, movedOnly);
+	}
+}
+
+/*
+ * Gathers the primitives of nodes that haven't moved by walking the model's BVH, so that culling visits a number of
+ * BVH nodes proportional to what is visible rather than every node in the model.
+ */
+static void gather_bvh(struct DrawQueue* queue, struct Model* model) {
+	uint32_t stack[BVH_MAX_DEPTH];
+	size_t   top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		struct BVHNode const* const b = model->bvh + stack[--top];
+		guVector const center = {(b->min.x + b->max.x) / 2, (b->min.y + b->max.y) / 2, (b->min.z + b->max.z) / 2};
+		guVector const extent = {(b->max.x - b->min.x) / 2, (b->max.y - b->min.y) / 2, (b->max.z - b->min.z) / 2};
+		if (!box_visible(&center, &extent)) {
+			frameStats.subtreesCulled++;
+			continue;
+		}
+
+		if (b->count == 0) {
+			stack[top++] = b->first;
+			stack[top++] = (uint32_t)(b - model->bvh) + 1;
+			continue;
+		}
+		for (struct BVHItem const* item = model->bvhItems + b->first; item < model->bvhItems + b->first + b->count;
+		     item++) {
+			struct Node* const node = model->nodes + item->node;
+			if (node->moved) continue; // Drawn by gather_tree()
+			gather_primitive(queue, model, node, model->primitives + item->primitive);
+		}
 	}
 }
 
 static void draw_model(struct Model* model) {
 	for (size_t s = 0; s < model->numScenes; s++) {
-		draw_scene(model->scenes + s, model);
+		struct Scene* const scene = model->scenes + s;
+		for (size_t i = 0; i < scene->numNodes; i++) {
+			update_tree(model, model->nodes + scene->nodesIdxs[i], false);
+		}
 	}
+	model->posed = true;
+	if (frustumGeneration != cameraGeneration) update_frustum();
+
+	struct DrawItem* const items =
+	    mem_alloc_frame(DRAW_QUEUE_CAPACITY * sizeof(struct DrawItem), alignof(struct DrawItem));
+	struct DrawQueue queue = {.items = items, .count = 0};
+	if (model->bvh != NULL) gather_bvh(&queue, model);
+	for (size_t s = 0; s < model->numScenes; s++) {
+		gather_scene(&queue, model->scenes + s, model, model->bvh != NULL);
+	}
+	flush_queue(&queue);
 }
 
 void render_tick(struct Model* model) {
+	lastFrameStats = frameStats;
+	memset(&frameStats, 0, sizeof(frameStats));
+	mem_reset_frame();
+
 	GX_CopyDisp(currentXFB, GX_TRUE);
 	VIDEO_WaitVSync();
 
@@ -0,0 +1,62 @@
+/*
+ORCA
+Copyright (C) 2026 leonardus
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "yaz0.h"
+
+uint32_t yaz0_get_size(void const* src) {
+	uint8_t const* const header = src;
+	return (uint32_t)header[4] << 24 | (uint32_t)header[5] << 16 | (uint32_t)header[6] << 8 | header[7];
+}
+
+void yaz0_decode(void const* src, void* dst) {
+	uint8_t const* in = src;
+	if (memcmp(in, "Yaz0", 4) != 0) {
+		printf("ERROR: Compressed data is not a Yaz0 stream\n");
+		exit(1);
+	}
+	uint8_t*       out = dst;
+	uint8_t* const end = out + yaz0_get_size(src);
+	in += YAZ0_HEADER_SIZE;
+
+	/* Each group header byte says, from its top bit down, whether the next 8 chunks are literals or back-references */
+	uint8_t code = 0;
+	int     bits = 0;
+	while (out < end) {
+		if (bits == 0) {
+			code = *in++;
+			bits = 8;
+		}
+		if (code & 0x80) {
+			*out++ = *in++;
+		} else {
+			uint8_t const  b1 = *in++;
+			uint8_t const  b2 = *in++;
+			uint8_t const* from = out - (((b1 & 0x0F) << 8 | b2) + 1);
+			size_t         n = b1 >> 4;
+			n = n == 0 ? (size_t)*in++ + 0x12 : n + 2;
+			while (n-- > 0) { // Byte by byte, as a back-reference may overlap its own output
+				*out++ = *from++;
+			}
+		}
+		code <<= 1;
+		bits--;
+	}
+}
@@ -18,6 +18,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 ]]
 
+option("fst_trace")
+	set_default(false)
+	set_showmenu(true)
+	set_description("Record DVD reads for `orca trace` in release builds")
+	add_defines("FST_TRACE")
+option_end()
+
 target("runtime")
 	add_rules("ORCAEnv")
 	set_plat("dolphin")
@@ -32,6 +39,7 @@ target("runtime")
 	add_sysincludedirs(path.join("$(env DEVKITPRO)", "libogc-orca", "include"))
 	add_syslinks("ogc")
 	add_defines("OGC")
+	add_options("fst_trace")
 
 	set_kind("binary")
 	set_basename("ORCA")